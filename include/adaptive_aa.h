@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <glad/glad.h>
+#include "shader.h"
+#include "framebuffer.h"
+#include "cpu_renderer.h"
+
+class TileScheduler;
+
+// Adaptive antialiasing. The escape buffer is rendered at 1x; pixels whose
+// color or escape count jumps against a neighbour (aa_edge_pass.frag) get
+// samples - 1 extra jittered samples. Those live in a compact list, one run
+// of texels per edge pixel, so the palette pass can average them every frame
+// while the palette animates.
+class AdaptiveAA {
+public:
+    ShaderProgram edge_program;
+
+    AdaptiveAA();
+    AdaptiveAA(const AdaptiveAA& other) = delete;
+    AdaptiveAA& operator=(const AdaptiveAA& other) = delete;
+    ~AdaptiveAA();
+
+    bool init(const char* vertex_source);
+    // finds the edge pixels of a width x height image and lays out their
+    // samples. expects the fullscreen quad's VAO bound; returns the edge count
+    int find_edges(FrameBuffer& escape, FrameBuffer& colors, int width, int height, int iterations,
+                   float threshold, int samples);
+    // fills the samples with fractal pass `sp`, camera uniforms already set.
+    // with `sample_list` on, each texel of the target is one sample and
+    // iterates the position stored in `sample_pos` instead of the interpolated one
+    void render_samples(ShaderProgram& sp);
+    // same on the cpu
+    void render_samples(const EscapeView& view, TileScheduler& scheduler);
+    // sample list uniforms for palette_pass.frag, on texture units 2 and 3
+    void bind(ShaderProgram& palette_program);
+
+    int edges() const { return (int)edge_pixels.size(); }
+
+    // offset of sample k from the pixel center, in pixels; sample 0 is the center
+    static void sample_offset(int k, double& dx, double& dy);
+
+private:
+    FrameBuffer edge_mask;
+    FrameBuffer sample_buffer; // R32F, samples - 1 texels per edge pixel
+    GLuint index_texture; // R32F, sample list index per pixel or -1
+    GLuint pos_texture;   // RG32F, fractal shader `pos` of every sample
+    std::vector<int> edge_pixels; // y * width + x
+    std::vector<float> mask;
+    int width = 0, height = 0, samples = 1;
+    int list_width = 1, list_height = 1;
+    GLint max_texture_size = 1024; // both dimensions of the sample list stay under it
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "settings.h"
+
+// A zoom video from a few keyframes, rendered headless on the cpu.
+struct AnimationKeyframe {
+    double at = 0.0;   // seconds into the video
+    AppState state;
+    float time = 0.0f; // palette animation time
+};
+
+struct Animation {
+    int fps = 30;
+    std::string output = "-"; // "-" is stdout
+    std::string format = "y4m"; // "y4m" (yuv 4:2:0) or "raw" (rgb24, no header)
+    // Resample every frame from one exponential map (exp_map.h) around the
+    // deepest keyframe's center instead of rendering each one. Keyframe
+    // cameras are ignored, only their zooms count.
+    bool exp_map = false;
+    std::vector<AnimationKeyframe> keyframes; // sorted by `at`
+
+    int frame_count() const;
+};
+
+// {"fps": 30, "output": "zoom.y4m", "format": "y4m", "defaults": {...},
+//  "keyframes": [{"at": 0, ...}, {"at": 20, "zoom": 1e12, ...}]}
+// Keyframes use the mandelconfig keys and each one starts from the one before
+// it, so a keyframe only lists what changes. width/height come from the first.
+bool load_animation(const std::filesystem::path& path, const AppState& base, Animation& anim);
+// The view `t` seconds in. Zoom moves at a constant rate (linear in log2)
+// between keyframes and the camera moves so the next keyframe's center
+// drifts into place at the same rate, instead of racing there while the
+// view is still wide. Iterations and palette time are linear.
+AppState animation_state(const Animation& anim, double t, float& palette_time);
+// Renders every frame through a plan -> compute -> color -> write pipeline,
+// each stage on its own thread with a couple of frames queued between them.
+// `threads` computes escape values (0 = one per core). Returns false on error.
+bool render_animation(Animation& anim, int threads);
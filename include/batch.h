@@ -0,0 +1,68 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "settings.h"
+
+class TileScheduler;
+
+// One still for the headless renderer. `state` uses the same keys as
+// mandelconfig (camera, zoom, iterations, width/height, palette_state,
+// antialias/aa_samples/aa_threshold...).
+struct BatchJob {
+    AppState state;
+    std::string output; // .png
+    std::string escape_output; // also keep the raw escape values for --recolor, see escape_file.h
+    float time = 0.0f;  // seconds into the palette animation
+    int tile = 512;     // rendered and kept in memory one row of tiles at a time
+    bool checkpoint = true; // journal finished tiles so a rerun resumes, see export_journal.h
+    double cost = 0.0;  // rough estimate, for scheduling
+};
+
+// Reads a job file: either an array of jobs or {"defaults": {...}, "jobs": [...]}.
+// Every job starts from `base` with the defaults and then its own keys on top.
+bool load_jobs(const std::filesystem::path& path, const AppState& base, std::vector<BatchJob>& jobs);
+// Renders every job on the cpu, no window or GL context needed. Jobs run
+// longest-estimated first across `workers` threads (0 = one per core).
+// Returns the number of jobs that failed.
+int run_batch(std::vector<BatchJob>& jobs, int workers);
+
+// Pieces of the export path that the animation renderer (animation.h) reuses.
+
+// a plain camera_x/camera_y/zoom in `patch` also replaces the _hp strings in `into`
+void merge_state_json(nlohmann::json& into, const nlohmann::json& patch);
+
+// One image's camera converted for the cpu renderers, with the
+// perturbation reference orbit when the zoom needs one.
+struct CpuCamera {
+    int width = 0, height = 0;
+    bool deep = false;
+    EscapeView view;
+    DeepView deep_view;
+    std::shared_ptr<const ReferenceOrbit> reference;
+
+    // `previous` is kept if it still covers the view
+    void setup(const AppState& state, std::shared_ptr<const ReferenceOrbit> previous = nullptr);
+    // the window [x0, x0+w) x [y0, y0+h) of the image into a w x h buffer
+    void render(float* out, int x0, int y0, int w, int h, TileScheduler& scheduler) const;
+    // one sample of pixel (x, y), (dx, dy) off its center
+    float sample(int x, int y, double dx, double dy) const;
+};
+
+// palette_pass.frag's lookup, `colors` from palette_colors()
+glm::vec3 palette_color(float escape, int iterations, const std::vector<glm::vec3>& colors, bool smooth);
+void to_rgb8(const glm::vec3* rgb, size_t count, unsigned char* out);
+
+// Adaptive antialiasing as adaptive_aa.cpp does it, on an aw x ah window of
+// escape values and their colors. The pixels of [x0, x0+w) x [y0, y0+h)
+// (window coordinates) that differ from a neighbour become `edges`...
+void find_aa_edges(const AppState& state, const float* escape, const glm::vec3* rgb, int aw, int ah, int x0, int y0,
+                   int w, int h, std::vector<int>& edges);
+// ...each gets samples - 1 extra escape values (the window sits at image pixel (ax0, ay0))...
+void sample_aa_edges(const CpuCamera& camera, int samples, const std::vector<int>& edges, int ax0, int ay0, int aw,
+                     TileScheduler& scheduler, std::vector<float>& out);
+// ...and its color becomes the mean over all of them
+void resolve_aa_edges(const AppState& state, const std::vector<glm::vec3>& colors, int samples, const std::vector<int>& edges,
+                      const std::vector<float>& sample_escapes, glm::vec3* rgb);
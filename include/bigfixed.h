@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "floatexp.h"
+
+// Arbitrary-precision fixed-point real: a signed 32-bit integer part and
+// `frac_limbs()` 32-bit fraction limbs, stored little-endian in two's
+// complement. Enough range for camera coordinates and reference orbits
+// (|z| stays below 2^31), with precision that grows with the zoom.
+class BigFixed {
+public:
+    BigFixed() : limbs(2, 0) {}
+    BigFixed(double value, int frac_limbs = 2);
+    // exact up to the last fraction limb, for deltas far below 1e-308
+    BigFixed(const FloatExp& value, int frac_limbs);
+
+    // plain decimal ("-0.743643887037158704752191506114774"); false if malformed
+    static bool parse(const std::string& str, int frac_limbs, BigFixed& out);
+    // `digits` after the point; -1 prints every digit the limbs hold
+    std::string to_string(int digits = -1) const;
+    double to_double() const;
+    FloatExp to_floatexp() const;
+    // `n` doubles whose sum is the value to ~53n bits, leading term first
+    void to_expansion(double* parts, int n) const;
+
+    int frac_limbs() const { return (int)limbs.size() - 1; }
+    // extends with zeros or truncates the least significant limbs
+    void set_frac_limbs(int n);
+    bool is_negative() const { return (int32_t)limbs.back() < 0; }
+
+    BigFixed operator-() const;
+    BigFixed operator+(const BigFixed& other) const;
+    BigFixed operator-(const BigFixed& other) const;
+    BigFixed operator*(const BigFixed& other) const;
+    BigFixed& operator+=(const BigFixed& other) { return *this = *this + other; }
+
+private:
+    std::vector<uint32_t> limbs;
+
+    BigFixed abs() const { return is_negative() ? -*this : *this; }
+};
+
+// fraction limbs needed to address pixels at `zoom`, with headroom for the
+// ~2^64 growth of rounding error along a long reference orbit
+int frac_limbs_for_zoom(const FloatExp& zoom);
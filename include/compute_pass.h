@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "shader.h"
+
+// Alternative to drawing fractal_pass.frag into the escape framebuffer: a
+// compute shader (fractal_compute.comp) that imageStores the same R32F values,
+// with persistent workgroups and per-tile early exit.
+class ComputePass {
+public:
+    ShaderProgram program;
+
+    ComputePass();
+    ComputePass(const ComputePass& other) = delete;
+    ComputePass& operator=(const ComputePass& other) = delete;
+    ~ComputePass();
+
+    // false if the driver can't compile it (no compute or fp64 support)
+    bool init();
+    // fills the R32F `texture`; uniforms must already be set on `program`
+    void dispatch(GLuint texture, int width, int height);
+
+private:
+    GLuint counter;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+
+class TileScheduler;
+
+// Headless escape-time renderer. Fills the same R32F smooth-escape buffer as
+// fractal_pass.frag, so the palette pass can consume it unchanged.
+// Buffers are row-major with row 0 at the bottom, like a GL texture.
+
+enum class CpuKernel {
+    Scalar,
+    AVX2,   // 4 doubles / 8 floats per lane group
+    AVX512, // 8 doubles / 16 floats per lane group
+};
+
+// Scalar type the escape loop runs in. Each step roughly doubles the cost
+// (quad-double ~10x double-double), so the cheapest one from double up that
+// still resolves a pixel is picked from the zoom. Float only runs when picked by hand.
+enum class Numeric {
+    Auto,
+    Float,
+    Double,
+    DoubleDouble,
+    QuadDouble,
+};
+
+// Camera as the fractal shader sees it.
+struct EscapeView {
+    double camera_x = -0.65, camera_y = 0.0, zoom = 0.5;
+    // remaining digits of the camera as unevaluated sums camera_x + tail[0] + ...,
+    // only read by the double-double / quad-double kernels
+    double camera_x_tail[3] = {}, camera_y_tail[3] = {};
+    double aspect = 4.0 / 3.0; // the `resolution` uniform's x/y, not the buffer's
+    int max_iterations = 150;
+    Numeric numeric = Numeric::Auto;
+    double jitter_x = 0.0, jitter_y = 0.0; // sample offset from the pixel centers, in pixels
+    // the buffer can be a window of a larger image (tiled export): the image's
+    // size, 0 for the buffer's own, and where buffer pixel (0, 0) sits in it
+    int image_width = 0, image_height = 0;
+    int origin_x = 0, origin_y = 0;
+};
+
+// re0 and im are unevaluated sums of 4 doubles
+using EscapeSpanFn = void (*)(const double* re0, double re_step, const double* im, int first, int count, int iterations, float* out);
+// same pixels down one column; im holds 4 parts per row
+using EscapeColumnFn = void (*)(const double* re0, double re_step, int column, const double* im, int count, int iterations,
+                                float* out, int stride);
+
+// best kernel the running cpu supports
+CpuKernel cpu_detect_kernel();
+const char* cpu_kernel_name(CpuKernel kernel);
+EscapeSpanFn cpu_escape_span(CpuKernel kernel, Numeric numeric);
+EscapeColumnFn cpu_escape_column(CpuKernel kernel, Numeric numeric);
+
+const char* numeric_name(Numeric numeric);
+int numeric_bits(Numeric numeric);
+// cheapest type from double up that resolves pixels of a `height`-row image at `zoom`
+Numeric select_numeric(double zoom, int height);
+bool numeric_resolves(Numeric numeric, double zoom, int height);
+// same test for any mantissa width (the shaders' float-float has ~44 bits)
+bool mantissa_resolves(int bits, double zoom, int height);
+
+// single-threaded throughput of every kernel x numeric type the cpu runs,
+// printed to stdout (`--bench`)
+void cpu_print_benchmark();
+
+// Renders the sub-rectangle [x0, x0+w) x [y0, y0+h) of a width x height image
+// into `out` (which holds the whole image).
+void cpu_render_rect(const EscapeView& view, CpuKernel kernel, float* out, int width, int height,
+                     int x0, int y0, int w, int h);
+// column x, rows [y0, y0+h): bit-identical to the same pixels from cpu_render_rect
+void cpu_render_column(const EscapeView& view, CpuKernel kernel, float* out, int width, int height,
+                       int x, int y0, int h);
+void cpu_render_escape(const EscapeView& view, float* out, int width, int height);
+// same, split into tiles across the scheduler's workers
+void cpu_render_escape(const EscapeView& view, float* out, int width, int height, TileScheduler& scheduler);
+
+struct MarianiSilverOptions {
+    // with smooth coloring off, rectangles whose border is one palette entry
+    // are filled too, not just interior ones
+    bool integer_bands = false;
+    // extra rings inside the border that have to be uniform as well, to
+    // catch thin filaments that slip between border pixels
+    int guard = 0;
+};
+
+struct MarianiSilverStats {
+    long long computed = 0, filled = 0; // pixels
+};
+
+// Mariani-Silver subdivision (src/cpu/mariani_silver.cpp): only rectangle
+// borders are iterated, uniform ones are filled without iterating the inside.
+void cpu_render_mariani_silver(const EscapeView& view, float* out, int width, int height, TileScheduler& scheduler,
+                               const MarianiSilverOptions& options, MarianiSilverStats* stats = nullptr);
+// pixels where a Mariani-Silver render `a` and a brute-force one `b` differ:
+// bit for bit, or with integer_bands in palette entry
+long long mariani_silver_mismatches(const float* a, const float* b, size_t count, bool integer_bands);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Raw smooth-escape values of an export (the R32F buffer palette_pass.frag
+// reads), so it can be colored again without iterating (`--recolor`).
+//   header  EscapeFileHeader, then the job's parameters (camera, zoom,
+//           iterations, palette...) as json, zero padded to data_offset
+//   tiles   one per tile x tile block of the image, row-major over the grid
+//           from the top left, each page aligned and `tile_stride` bytes
+//           apart. Values go top row first like the png (unlike the gl
+//           buffers), edge tiles are padded to the full size.
+// Everything is little endian, so the file can be mapped and read in place.
+struct EscapeFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height, tile;
+    uint32_t iterations;
+    uint64_t params_size; // bytes of json after the header
+    uint64_t data_offset, tile_stride;
+};
+
+// Writes an escape file a tile at a time, in any order.
+class EscapeFileWriter {
+public:
+    EscapeFileWriter() = default;
+    EscapeFileWriter(const EscapeFileWriter& other) = delete;
+    EscapeFileWriter& operator=(const EscapeFileWriter& other) = delete;
+    ~EscapeFileWriter();
+
+    bool open(const std::string& path, int width, int height, int tile, int iterations, const nlohmann::json& params);
+    // tile (tx, ty) is w x h values, rows from the bottom like a render
+    bool write_tile(int tx, int ty, int w, int h, const float* escape);
+    bool close();
+
+private:
+    FILE* file = nullptr;
+    EscapeFileHeader header{};
+};
+
+// A finished escape file, mapped read-only.
+class EscapeFile {
+public:
+    EscapeFile() = default;
+    EscapeFile(const EscapeFile& other) = delete;
+    EscapeFile& operator=(const EscapeFile& other) = delete;
+    ~EscapeFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    int width() const { return header.width; }
+    int height() const { return header.height; }
+    int tile() const { return header.tile; }
+    int iterations() const { return header.iterations; }
+    const nlohmann::json& params() const { return params_json; }
+    // tile x tile values, top row first
+    const float* tile_data(int tx, int ty) const;
+
+private:
+    EscapeFileHeader header{};
+    nlohmann::json params_json;
+    const unsigned char* base = nullptr;
+    size_t mapped_bytes = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "simd.h"
+#include "multi_double.h"
+
+// CPU port of mandel() from fractal_pass.frag, written once against the lane
+// packs in simd.h and instantiated per instruction set and numeric type.
+
+// same bailout as the shader: length(z) > (1<<16)
+constexpr double ESCAPE_RADIUS_SQ = double(1 << 16) * double(1 << 16);
+
+// smooth iteration count, evaluated in float like the shader does.
+// `i == 0` means the orbit never escaped.
+inline float smooth_escape(int i, double mag_sq, int iterations) {
+    if (i == 0) return float(iterations + 1);
+    float log_zn = std::log(float(mag_sq)) / 2.0f;
+    float nu = std::log(log_zn / std::log(2.0f)) / std::log(2.0f);
+    return i + 1.0f - nu;
+}
+
+// Iterates one lane group of c values, leaving the escape iteration (0 if it
+// never escaped) and |z|^2 at that point in each lane.
+template <class R>
+void escape_lanes(const R& cx, const R& cy, int iterations, typename RealTraits<R>::Lane::Elem* iter_lanes,
+                  typename RealTraits<R>::Lane::Elem* mag_lanes) {
+    using Traits = RealTraits<R>;
+    using V = typename Traits::Lane;
+    using T = typename V::Elem;
+    const V bailout = V(T(ESCAPE_RADIUS_SQ));
+    R zx = V(T(0)), zy = V(T(0));
+    V iter = V(T(0)), mag = V(T(0));
+    // main cardioid or period-2 bulb: never escapes, same test as the shaders
+    V x = Traits::lead(cx), y = Traits::lead(cy);
+    V y2 = y * y, xq = x - V(T(0.25)), x1 = x + V(T(1));
+    V q = xq * xq + y2;
+    typename V::Mask active = mask_and(q * (q + xq) > V(T(0.25)) * y2, x1 * x1 + y2 > V(T(0.0625)));
+
+    int last = any(active) ? iterations : 0;
+    for (int i = 1; i <= last; i++) {
+        R x2 = zx * zx, y2 = zy * zy, xy = zx * zy;
+        zx = x2 - y2 + cx;
+        zy = xy + xy + cy;
+        // the leading term is plenty for the bailout test
+        V lx = Traits::lead(zx), ly = Traits::lead(zy);
+        V mag_sq = lx * lx + ly * ly;
+
+        auto escaped = mask_and(active, mag_sq > bailout);
+        if (any(escaped)) {
+            iter = select(escaped, V(T(i)), iter);
+            mag = select(escaped, mag_sq, mag);
+            active = mask_andnot(escaped, active);
+            if (!any(active)) break;
+        }
+    }
+    iter.store(iter_lanes);
+    mag.store(mag_lanes);
+}
+
+// Escape values for `count` pixels on one row, starting at column `first`:
+// c = (re0 + k * re_step, im). `out` points at column `first`. Each c only
+// depends on its column, so tiles reproduce a full-row render exactly.
+// `re0` and `im` are unevaluated sums of 4 doubles; R is a lane pack from
+// simd.h, or DD<>/QD<> of one (multi_double.h).
+template <class R>
+void escape_span(const double* re0, double re_step, const double* im, int first, int count, int iterations, float* out) {
+    using Traits = RealTraits<R>;
+    using T = typename Traits::Lane::Elem;
+    constexpr int W = Traits::Lane::width;
+    const R cy = Traits::from(im);
+    T iter_lanes[W], mag_lanes[W];
+
+    for (int k0 = 0; k0 < count; k0 += W) {
+        escape_lanes(Traits::ramp(re0, re_step, first + k0), cy, iterations, iter_lanes, mag_lanes);
+        int n = std::min(W, count - k0);
+        for (int k = 0; k < n; k++) out[k0 + k] = smooth_escape(int(iter_lanes[k]), mag_lanes[k], iterations);
+    }
+}
+
+// Same values for `count` pixels down column `column`, one lane per row:
+// c = (re0 + column * re_step, im[4k..4k+3]), written `stride` floats apart.
+// c is rounded exactly like escape_span's, so a column matches the rows
+// crossing it bit for bit.
+template <class R>
+void escape_column(const double* re0, double re_step, int column, const double* im, int count, int iterations,
+                   float* out, int stride) {
+    using Traits = RealTraits<R>;
+    using T = typename Traits::Lane::Elem;
+    constexpr int W = Traits::Lane::width;
+    const R cx = Traits::at(re0, re_step, column);
+    T iter_lanes[W], mag_lanes[W];
+    double parts[4 * W] = {};
+
+    for (int k0 = 0; k0 < count; k0 += W) {
+        int n = std::min(W, count - k0);
+        // transpose to one array per part, the tail lanes repeat the last row
+        for (int k = 0; k < W; k++) {
+            for (int p = 0; p < 4; p++) parts[p * W + k] = im[4 * (k0 + std::min(k, n - 1)) + p];
+        }
+        escape_lanes(cx, Traits::gather(parts, W), iterations, iter_lanes, mag_lanes);
+        for (int k = 0; k < n; k++) out[(size_t)(k0 + k) * stride] = smooth_escape(int(iter_lanes[k]), mag_lanes[k], iterations);
+    }
+}
+
+// one instantiation per numeric type, for a single ISA
+#define ESCAPE_SPAN_TABLE(V, VF) { escape_span<VF>, escape_span<V>, escape_span<DD<V>>, escape_span<QD<V>> }
+#define ESCAPE_COLUMN_TABLE(V, VF) { escape_column<VF>, escape_column<V>, escape_column<DD<V>>, escape_column<QD<V>> }
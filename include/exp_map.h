@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "perturbation.h"
+
+class TileScheduler;
+
+// Exponential map of a zoom: the plane around a fixed center sampled in
+// log-polar coordinates, columns going around the circle and rows going
+// inward, one row per 2*pi/columns of log radius so samples stay square.
+// One strip covers every frame of a zoom into that center, so each point is
+// computed once instead of once per frame. Frames are resampled from it, and
+// a conventional square render at the deepest zoom fills the middle, where
+// the strip would need rows all the way to radius 0.
+class ExpMap {
+public:
+    using IterationsFn = std::function<int(const FloatExp& zoom)>;
+
+    // Covers width x height frames zoomed anywhere from `zoom_min` to
+    // `zoom_max` around (cx, cy). `iterations` gives a frame's max_iterations
+    // at a zoom; each row uses the largest of the frames that show it.
+    void build(const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom_min, const FloatExp& zoom_max, int width,
+               int height, const IterationsFn& iterations, TileScheduler& scheduler);
+    // A frame at `zoom` colored with `colors` (palette_colors() for
+    // `iterations`), rows from the bottom. `samples` > 1 averages that many
+    // points per pixel, spread like the antialiasing samples.
+    void resample(const FloatExp& zoom, int iterations, const std::vector<glm::vec3>& colors, bool smooth, int samples,
+                  glm::vec3* rgb, TileScheduler& scheduler) const;
+
+    // points computed for the strip and the middle
+    size_t points() const { return strip.size() + patch.size(); }
+
+private:
+    int width = 0, height = 0;
+    int columns = 0, rows = 0;
+    double step = 0.0;            // log radius (base e) from one row to the next, and angle between columns
+    double log2_outer = 0.0;      // radius of row 0
+    double log2_patch_pixel = 0.0; // pixel size of the middle render
+    int patch_size = 0;
+    ReferenceOrbit reference;
+    std::vector<float> strip; // rows x columns, row 0 outermost; inside the set is +inf
+    std::vector<float> patch; // patch_size^2, rows from the bottom
+};
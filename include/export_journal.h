@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+
+// Checkpoint of a tiled export, so a rerun of the same job picks up where a
+// crash left off. Both files only ever grow:
+//   <output>.journal  first line the job's parameters, then one line per
+//                     finished tile: position, size, offset and crc32 of its data
+//   <output>.tiles    each finished tile's escape values (float, rows from the
+//                     bottom) followed by its final rgb8 pixels
+// A tile's line is written after its data, so a torn write at the end only
+// loses that tile; lines with a bad crc are rendered again.
+class ExportJournal {
+public:
+    ExportJournal() = default;
+    ExportJournal(const ExportJournal& other) = delete;
+    ExportJournal& operator=(const ExportJournal& other) = delete;
+    ~ExportJournal();
+
+    // resumes the journal beside `output` if it was written for `params`,
+    // otherwise starts a new one
+    bool open(const std::string& output, const std::string& params);
+    // the tile at (x0, y0) from an earlier run; false if it has to be rendered
+    bool load(int x0, int y0, int w, int h, float* escape, unsigned char* rgb);
+    bool append(int x0, int y0, int w, int h, const float* escape, const unsigned char* rgb);
+    // the export is complete, removes both files
+    void finish();
+
+    int resumed_tiles() const { return (int)entries.size(); }
+
+private:
+    struct Entry {
+        int w, h;
+        long long offset;
+        unsigned long crc;
+    };
+    void close();
+
+    std::string journal_path, data_path;
+    FILE* journal = nullptr;
+    FILE* data = nullptr;
+    long long data_size = 0;
+    std::map<std::pair<int, int>, Entry> entries; // by (x0, y0)
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Extended-exponent float: value = m * 2^e with m in [0.5, 1) (or 0) and a
+// separate int exponent, so magnitudes far beyond 1e+-308 (zoom 1e1000 and
+// its pixel deltas) stay representable at double-mantissa precision.
+// The GLSL twin (float mantissa) lives in perturbation_floatexp_pass.frag.
+struct FloatExp {
+    double m = 0.0;
+    int e = 0;
+
+    FloatExp() = default;
+    FloatExp(double value) : m(value), e(0) { normalize(); }
+    FloatExp(double mantissa, int exponent) : m(mantissa), e(exponent) { normalize(); }
+
+    // back to a native double; 0 or inf when out of range
+    double to_double() const { return std::ldexp(m, e); }
+    // log2(|value|), for picking precisions and thresholds
+    double log2() const { return m == 0.0 ? -1e300 : std::log2(std::fabs(m)) + e; }
+    // 2^l, for l far outside a double's exponent range
+    static FloatExp from_log2(double l) {
+        double whole = std::floor(l);
+        return FloatExp(std::exp2(l - whole), (int)whole);
+    }
+
+    // "1.2345678901234567e1000"
+    std::string to_string(int precision = 16) const;
+    static bool parse(const std::string& str, FloatExp& out);
+
+    // brings m back into [0.5, 1) by moving its binary exponent into e.
+    // inf and NaN are left as they are
+    void normalize() {
+        uint64_t bits;
+        std::memcpy(&bits, &m, sizeof bits);
+        int biased = (int)((bits >> 52) & 0x7FF);
+        if (biased == 0x7FF) return;
+        if (biased == 0) { // zero or denormal
+            if (m == 0.0) { e = 0; return; }
+            int k;
+            m = std::frexp(m, &k);
+            e += k;
+            return;
+        }
+        e += biased - 1022;
+        bits = (bits & ~(0x7FFull << 52)) | (1022ull << 52);
+        std::memcpy(&m, &bits, sizeof bits);
+    }
+};
+
+inline FloatExp operator-(const FloatExp& a) {
+    FloatExp r = a;
+    r.m = -r.m;
+    return r;
+}
+
+inline FloatExp operator*(const FloatExp& a, const FloatExp& b) { return FloatExp(a.m * b.m, a.e + b.e); }
+inline FloatExp operator/(const FloatExp& a, const FloatExp& b) { return FloatExp(a.m / b.m, a.e - b.e); }
+
+inline FloatExp operator+(const FloatExp& a, const FloatExp& b) {
+    if (a.m == 0.0) return b;
+    if (b.m == 0.0) return a;
+    int diff = a.e - b.e;
+    // past 64 bits the smaller term can't change the result
+    if (diff > 64) return a;
+    if (diff < -64) return b;
+    return diff >= 0 ? FloatExp(a.m + std::ldexp(b.m, -diff), a.e) : FloatExp(std::ldexp(a.m, diff) + b.m, b.e);
+}
+inline FloatExp operator-(const FloatExp& a, const FloatExp& b) { return a + -b; }
+
+inline FloatExp& operator+=(FloatExp& a, const FloatExp& b) { return a = a + b; }
+inline FloatExp& operator*=(FloatExp& a, const FloatExp& b) { return a = a * b; }
+inline FloatExp& operator/=(FloatExp& a, const FloatExp& b) { return a = a / b; }
+
+// normalized operands compare by sign, then exponent, then mantissa
+inline int compare(const FloatExp& a, const FloatExp& b) {
+    int sa = (a.m > 0) - (a.m < 0), sb = (b.m > 0) - (b.m < 0);
+    if (sa != sb) return sa < sb ? -1 : 1;
+    if (sa == 0) return 0;
+    if (a.e != b.e) return (a.e < b.e) == (sa > 0) ? -1 : 1;
+    return a.m < b.m ? -1 : (a.m > b.m ? 1 : 0);
+}
+inline bool operator<(const FloatExp& a, const FloatExp& b) { return compare(a, b) < 0; }
+inline bool operator>(const FloatExp& a, const FloatExp& b) { return compare(a, b) > 0; }
+inline bool operator<=(const FloatExp& a, const FloatExp& b) { return compare(a, b) <= 0; }
+inline bool operator>=(const FloatExp& a, const FloatExp& b) { return compare(a, b) >= 0; }
+inline bool operator==(const FloatExp& a, const FloatExp& b) { return compare(a, b) == 0; }
+inline bool operator!=(const FloatExp& a, const FloatExp& b) { return compare(a, b) != 0; }
+
+inline std::string FloatExp::to_string(int precision) const {
+    char buf[64];
+    if (std::abs(e) < 1000) { // in double range, let printf round
+        std::snprintf(buf, sizeof buf, "%.*e", precision, to_double());
+        return buf;
+    }
+    // long double keeps the huge exponent from eating the mantissa digits (on x86)
+    long double log10v = std::log10((long double)std::fabs(m)) + e * std::log10(2.0L);
+    long double exp10 = std::floor(log10v);
+    long double scale = std::pow(10.0L, precision);
+    double mant10 = (double)(std::round(std::pow(10.0L, log10v - exp10) * scale) / scale);
+    if (mant10 >= 10.0) mant10 /= 10.0, exp10 += 1.0L;
+    std::snprintf(buf, sizeof buf, "%s%.*fe%.0f", m < 0 ? "-" : "", precision, mant10, (double)exp10);
+    return buf;
+}
+
+inline bool FloatExp::parse(const std::string& str, FloatExp& out) {
+    // split off the exponent ourselves, strtod would overflow on "1e1000"
+    size_t pos = str.find_first_of("eE");
+    std::string mant_str = str.substr(0, pos);
+    char* end = nullptr;
+    double mant10 = std::strtod(mant_str.c_str(), &end);
+    if (mant_str.empty() || *end != '\0') return false;
+    long long exp10 = 0;
+    if (pos != std::string::npos) {
+        std::string exp_str = str.substr(pos + 1);
+        exp10 = std::strtoll(exp_str.c_str(), &end, 10);
+        if (exp_str.empty() || *end != '\0') return false;
+    }
+    if (std::llabs(exp10) < 300) {
+        out = FloatExp(std::strtod(str.c_str(), nullptr));
+        return true;
+    }
+    // mant10 * 10^exp10 = mant10 * 2^(exp10 * log2(10))
+    long double t = exp10 * std::log2(10.0L);
+    long double whole = std::floor(t);
+    out = FloatExp(mant10 * (double)std::exp2(t - whole), (int)whole);
+    return true;
+}
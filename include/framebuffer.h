@@ -7,6 +7,7 @@ public:
     enum class Format {
         RGB8,
         R32F,
+        RGBA32F,
     };
 
     GLuint id;
@@ -21,6 +22,8 @@ public:
     ~FrameBuffer();
 
     void resize(int width, int height);
+    void upload(const void* pixels);
+    void download(void* pixels);
     void bind();
     void unbind();
     void bind_texture();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <glad/glad.h>
+#include "shader.h"
+#include "framebuffer.h"
+
+// GPU Mariani-Silver: fills the escape framebuffer level by level, 64px
+// blocks down to a few pixels. Each level marks the block borders, lets the
+// fractal pass iterate just those, and fills every block whose border agrees.
+// Same rules as cpu_render_mariani_silver(), with a fixed block grid.
+class MarianiSilverPass {
+public:
+    ShaderProgram resolve_program;
+    ShaderProgram decide_program;
+
+    // draws the fractal pass into the bound framebuffer in `reproject` mode,
+    // with the marked texture on unit 0
+    using EscapePassFn = std::function<void()>;
+
+    MarianiSilverPass();
+    MarianiSilverPass(const MarianiSilverPass& other) = delete;
+    MarianiSilverPass& operator=(const MarianiSilverPass& other) = delete;
+
+    bool init(const char* vertex_source);
+    // expects the fullscreen quad's VAO bound
+    void render(FrameBuffer& target, int width, int height, int guard, bool integer_bands, int iterations,
+                const EscapePassFn& escape_pass);
+
+private:
+    FrameBuffer marked;    // target with the texels to iterate set to MISSING
+    FrameBuffer decisions; // one texel per block
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+// Double-double and quad-double arithmetic over any lane pack from simd.h:
+// a value is an unevaluated sum of 2 or 4 non-overlapping packs, giving
+// ~106 and ~212 bits of mantissa. The algorithms are the branch-free
+// ("sloppy") variants of Hida, Li & Bailey's QD library, so every lane runs
+// the same instructions. Products use fms() for the exact low half.
+
+// s + err == a + b exactly
+template <class V> inline V two_sum(V a, V b, V& err) {
+    V s = a + b;
+    V bb = s - a;
+    err = (a - (s - bb)) + (b - bb);
+    return s;
+}
+// same, if |a| >= |b|
+template <class V> inline V quick_two_sum(V a, V b, V& err) {
+    V s = a + b;
+    err = b - (s - a);
+    return s;
+}
+template <class V> inline V two_prod(V a, V b, V& err) {
+    V p = a * b;
+    err = fms(a, b, p);
+    return p;
+}
+
+template <class V>
+struct DD {
+    V hi, lo;
+
+    DD() = default;
+    DD(V h) : hi(h), lo(0.0) {}
+    DD(V h, V l) : hi(h), lo(l) {}
+};
+
+template <class V> inline DD<V> operator+(const DD<V>& a, const DD<V>& b) {
+    V e;
+    V s = two_sum(a.hi, b.hi, e);
+    e = e + (a.lo + b.lo);
+    s = quick_two_sum(s, e, e);
+    return {s, e};
+}
+template <class V> inline DD<V> operator-(const DD<V>& a) { return {-a.hi, -a.lo}; }
+template <class V> inline DD<V> operator-(const DD<V>& a, const DD<V>& b) { return a + -b; }
+template <class V> inline DD<V> operator*(const DD<V>& a, const DD<V>& b) {
+    V e;
+    V p = two_prod(a.hi, b.hi, e);
+    e = e + (a.hi * b.lo + a.lo * b.hi);
+    p = quick_two_sum(p, e, e);
+    return {p, e};
+}
+
+template <class V>
+struct QD {
+    V x[4];
+
+    QD() = default;
+    QD(V a) : x{a, V(0.0), V(0.0), V(0.0)} {}
+    QD(V a, V b, V c, V d) : x{a, b, c, d} {}
+};
+
+// a, b, c -> a + b + c with a the leading term, b and c the errors
+template <class V> inline void three_sum(V& a, V& b, V& c) {
+    V t1, t2, t3;
+    t1 = two_sum(a, b, t2);
+    a = two_sum(c, t1, t3);
+    b = two_sum(t2, t3, c);
+}
+template <class V> inline void three_sum2(V& a, V& b, V& c) {
+    V t1, t2, t3;
+    t1 = two_sum(a, b, t2);
+    a = two_sum(c, t1, t3);
+    b = t2 + t3;
+}
+// branch-free renormalization of a 5-term sum into 4 non-overlapping terms
+template <class V> inline QD<V> renorm(V c0, V c1, V c2, V c3, V c4) {
+    V s = quick_two_sum(c3, c4, c4);
+    s = quick_two_sum(c2, s, c3);
+    s = quick_two_sum(c1, s, c2);
+    c0 = quick_two_sum(c0, s, c1);
+    c0 = quick_two_sum(c0, c1, c1);
+    c1 = quick_two_sum(c1, c2, c2);
+    c2 = quick_two_sum(c2, c3, c3);
+    return {c0, c1, c2, c3 + c4};
+}
+
+template <class V> inline QD<V> operator+(const QD<V>& a, const QD<V>& b) {
+    V t0, t1, t2, t3;
+    V s0 = two_sum(a.x[0], b.x[0], t0);
+    V s1 = two_sum(a.x[1], b.x[1], t1);
+    V s2 = two_sum(a.x[2], b.x[2], t2);
+    V s3 = two_sum(a.x[3], b.x[3], t3);
+    s1 = two_sum(s1, t0, t0);
+    three_sum(s2, t0, t1);
+    three_sum2(s3, t0, t2);
+    t0 = t0 + t1 + t3;
+    return renorm(s0, s1, s2, s3, t0);
+}
+template <class V> inline QD<V> operator-(const QD<V>& a) { return {-a.x[0], -a.x[1], -a.x[2], -a.x[3]}; }
+template <class V> inline QD<V> operator-(const QD<V>& a, const QD<V>& b) { return a + -b; }
+template <class V> inline QD<V> operator*(const QD<V>& a, const QD<V>& b) {
+    V q0, q1, q2, q3, q4, q5, t0, t1;
+    V p0 = two_prod(a.x[0], b.x[0], q0);
+    V p1 = two_prod(a.x[0], b.x[1], q1);
+    V p2 = two_prod(a.x[1], b.x[0], q2);
+    V p3 = two_prod(a.x[0], b.x[2], q3);
+    V p4 = two_prod(a.x[1], b.x[1], q4);
+    V p5 = two_prod(a.x[2], b.x[0], q5);
+
+    three_sum(p1, p2, q0);
+    // (p2, q1, q2) + (p3, p4, p5)
+    three_sum(p2, q1, q2);
+    three_sum(p3, p4, p5);
+    V s0 = two_sum(p2, p3, t0);
+    V s1 = two_sum(q1, p4, t1);
+    V s2 = q2 + p5;
+    s1 = two_sum(s1, t0, t0);
+    s2 = s2 + (t0 + t1);
+
+    // O(eps^3) terms
+    s1 = s1 + (a.x[0] * b.x[3] + a.x[1] * b.x[2] + a.x[2] * b.x[1] + a.x[3] * b.x[0] + q0 + q3 + q4 + q5);
+    return renorm(p0, p1, s0, s1, s2);
+}
+
+// How the escape kernel builds and reads each numeric type. `parts` is an
+// unevaluated sum of up to 4 doubles (the camera at full precision).
+// at() is lane `first` of ramp() in every lane; gather() is from() with a
+// different value per lane, part p of lane k at parts[p * stride + k].
+template <class R> struct RealTraits {
+    using Lane = R;
+    using Elem = typename R::Elem;
+    static R from(const double* parts) { return R(Elem(parts[0])); }
+    static R ramp(const double* base, double step, int first) { return R::ramp(Elem(base[0]), Elem(step), first); }
+    static R at(const double* base, double step, int first) { return R(Elem(Elem(base[0]) + Elem(first) * Elem(step))); }
+    // only part 0, which starts at parts[0] whatever the stride
+    static R gather(const double* parts, int /*stride*/) {
+        Elem lanes[R::width];
+        for (int k = 0; k < R::width; k++) lanes[k] = Elem(parts[k]);
+        return R::load(lanes);
+    }
+    static Lane lead(const R& r) { return r; }
+};
+
+template <class V> struct RealTraits<DD<V>> {
+    using Lane = V;
+    static DD<V> from(const double* parts) { return DD<V>(V(parts[0])) + DD<V>(V(parts[1])); }
+    static DD<V> ramp(const double* base, double step, int first) { return from(base) + DD<V>(V::ramp(0.0, step, first)); }
+    static DD<V> at(const double* base, double step, int first) { return from(base) + DD<V>(V(0.0 + double(first) * step)); }
+    static DD<V> gather(const double* parts, int stride) {
+        return DD<V>(V::load(parts)) + DD<V>(V::load(parts + stride));
+    }
+    static Lane lead(const DD<V>& r) { return r.hi; }
+};
+
+template <class V> struct RealTraits<QD<V>> {
+    using Lane = V;
+    static QD<V> from(const double* parts) {
+        return QD<V>(V(parts[0])) + QD<V>(V(parts[1])) + QD<V>(V(parts[2])) + QD<V>(V(parts[3]));
+    }
+    static QD<V> ramp(const double* base, double step, int first) { return from(base) + QD<V>(V::ramp(0.0, step, first)); }
+    static QD<V> at(const double* base, double step, int first) { return from(base) + QD<V>(V(0.0 + double(first) * step)); }
+    static QD<V> gather(const double* parts, int stride) {
+        return QD<V>(V::load(parts)) + QD<V>(V::load(parts + stride)) + QD<V>(V::load(parts + 2 * stride)) +
+               QD<V>(V::load(parts + 3 * stride));
+    }
+    static Lane lead(const QD<V>& r) { return r.x[0]; }
+};
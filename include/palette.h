@@ -8,24 +8,76 @@
 // `0.5f + 0.5f * cos(x_offset + iteration * x_scale + time_scale*secs);`
 // float operator()(float iteration);
 
-// Manages a 1D texture of RGB colors, and the UI to control it.
+// red/green/blue channels, if the state has none yet
+void default_channels(PaletteState& state);
+
+// The channels pulled out of the map once into flat arrays, so a whole
+// palette is one branch-free loop per channel (which the compiler
+// vectorizes) instead of three string lookups and a libm cos per entry.
+struct PaletteChannels {
+    static constexpr int RED = 0, GREEN = 1, BLUE = 2;
+    float y_scale[3] = {}, x_offset[3] = {}, x_scale[3] = {}, t_scale[3] = {};
+    bool reversed = false;
+    bool override = false;
+    float override_color[3] = {};
+
+    PaletteChannels() = default;
+    explicit PaletteChannels(const PaletteState& state);
+    bool operator==(const PaletteChannels& other) const;
+    bool operator!=(const PaletteChannels& other) const { return !(*this == other); }
+
+    // the colors move with time
+    bool animated() const;
+    // channel `c` of all `n` entries, `time` seconds into the animation
+    void evaluate(int c, int n, float time, float* out) const;
+    // one entry, the same value evaluate() gives it
+    glm::vec3 at(int i, int n, float time) const;
+};
+
+// the colors Palette::generate() uploads, `time` seconds into the animation
+void palette_colors(const PaletteState& state, int num_colors, float time, std::vector<glm::vec3>& colors);
+
+// The palette on the gpu and the UI to control it. Entries live in a
+// persistently mapped buffer read through a samplerBuffer (1D textures top
+// out at 16k texels, high iteration counts need millions): all reds, then
+// all greens, then all blues. palette_pass.frag does the filtering itself.
+// The buffer is only rewritten when the palette changes, or every frame if
+// it's animated, and two halves take turns so the cpu never writes what
+// the gpu may still be reading.
 class Palette {
 private:
     PaletteState* state;
-    GLuint texture;
-    std::vector<glm::vec3> colors;
+    GLuint buffer = 0, texture = 0;
+    float* mapped = nullptr;
+    size_t region_floats = 0; // per half
+    int region = 0;
+    GLsync fences[2] = {};
+    GLint max_entries = 0;
+
+    // what the current half holds
+    PaletteChannels uploaded;
+    int size = 0;
+    float time = 0.0f;
+    bool valid = false;
+
+    void reserve(int entries);
+    // preview and plot samples, at most this many
+    std::vector<float> plot_x, plot_y;
 public:
 
     Palette(PaletteState* state);
+    Palette(const Palette& other) = delete;
+    Palette& operator=(const Palette& other) = delete;
+    ~Palette();
     // bool add_channel(std::string& label);
     void draw_channel_settings(const std::string& name, ChannelState& channel);
 
     void reverse();
-    // void resize(int size);
-    void generate(int num_colors);
-    void update_filter();
-    void bind_texture();
-    void unbind_texture();
+    // `num_colors` entries, `time` seconds into the animation
+    void generate(int num_colors, float time);
+    bool animated() const { return uploaded.animated(); }
+    // the buffer on texture unit `unit`, and the uniforms palette_pass.frag needs
+    void bind(ShaderProgram& sp, int unit);
     void draw_ui();
 
 };
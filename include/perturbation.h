@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+#include "bigfixed.h"
+
+class TileScheduler;
+
+// Deep zoom by perturbation. One reference orbit Z_n is iterated at full
+// precision on the cpu; every pixel then only iterates its delta from it,
+//   dz' = 2 Z_n dz + dz^2 + dc
+// in plain doubles. When |Z_n + dz| < |dz| (the usual glitch condition) or the
+// reference runs out, the pixel rebases onto Z_0 = 0 with dz = Z_n + dz, so
+// glitches are caught and repaired per pixel instead of accumulating.
+
+// past this zoom, double camera coordinates can no longer address pixels
+constexpr double DEEP_ZOOM_THRESHOLD = 1e12;
+// past this, pixel deltas underflow doubles and are iterated as FloatExp
+constexpr double FLOATEXP_ZOOM_THRESHOLD = 1e290;
+
+struct ReferenceOrbit {
+    BigFixed center_x, center_y;
+    FloatExp zoom;
+    int iterations = 0;
+    std::vector<double> z; // Z_0 .. Z_{n-1} as (re, im) pairs
+    int length() const { return (int)z.size() / 2; }
+};
+
+// camera relative to a reference orbit, in extended range
+struct DeepView {
+    FloatExp offset_x, offset_y; // camera minus reference center
+    FloatExp zoom;
+    double aspect = 4.0 / 3.0;
+    int max_iterations = 150;
+    // same as in EscapeView
+    double jitter_x = 0.0, jitter_y = 0.0;
+    int image_width = 0, image_height = 0;
+    int origin_x = 0, origin_y = 0;
+};
+
+void compute_reference_orbit(ReferenceOrbit& ref, const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom, int iterations);
+// true when the orbit is off-screen, not precise enough, or for other iterations
+bool reference_is_stale(const ReferenceOrbit& ref, const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom, int iterations);
+
+// smooth escape value for c = reference center + dc (cpu version of perturbation_pass.frag)
+float perturbed_escape(const ReferenceOrbit& ref, double dc_x, double dc_y, int iterations);
+// same with dz and dc as FloatExp, for zooms past FLOATEXP_ZOOM_THRESHOLD
+float perturbed_escape_fe(const ReferenceOrbit& ref, const FloatExp& dc_x, const FloatExp& dc_y, int iterations);
+
+// the sub-rectangle [x0, x0+w) x [y0, y0+h) of a width x height `out`
+void cpu_render_perturbed(const ReferenceOrbit& ref, const DeepView& view, float* out, int width, int height,
+                          int x0, int y0, int w, int h);
+void cpu_render_perturbed(const ReferenceOrbit& ref, const DeepView& view, float* out, int width, int height,
+                          TileScheduler& scheduler);
+
+// Shader storage buffer holding the reference orbit as dvec2[].
+class OrbitBuffer {
+public:
+    GLuint id;
+
+    OrbitBuffer();
+    OrbitBuffer(const OrbitBuffer& other) = delete;
+    OrbitBuffer& operator=(const OrbitBuffer& other) = delete;
+    ~OrbitBuffer();
+
+    void upload(const ReferenceOrbit& ref);
+    void bind(GLuint binding);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+class TileScheduler;
+
+// Writes an RGB8 PNG a band of rows at a time, so an image of any size goes
+// out with one band of state. Each band is cut into chunks of rows that are
+// filtered and deflated independently (pigz style: every chunk ends on a
+// sync flush, so they concatenate into one zlib stream), which lets the
+// chunks run in parallel. IDAT chunks are flushed whenever the output
+// buffer fills up.
+class PngStream {
+public:
+    PngStream() = default;
+    PngStream(const PngStream& other) = delete;
+    PngStream& operator=(const PngStream& other) = delete;
+    ~PngStream();
+
+    // `level` is zlib's, 1 (fastest) to 9
+    bool open(const std::string& path, int width, int height, int level = Z_DEFAULT_COMPRESSION);
+    // `count` rows of width * 3 bytes, top to bottom. With a scheduler the
+    // rows are encoded in chunks of its tile size across its workers.
+    bool write_rows(const unsigned char* rgb, int count, TileScheduler* scheduler = nullptr);
+    // after the last row; false if rows are missing or a write failed
+    bool close();
+
+private:
+    struct Chunk {
+        std::vector<unsigned char> data; // raw deflate, ending on a sync flush
+        size_t size = 0;                 // filtered bytes that went in
+        uLong adler = 0;
+        bool ok = false;
+    };
+
+    bool write_chunk(const char* type, const unsigned char* data, size_t size);
+    // `above` is the row before the first one, zeros at the top of the image
+    void encode(const unsigned char* rgb, const unsigned char* above, int count, Chunk& chunk) const;
+    bool emit(const unsigned char* data, size_t size);
+
+    FILE* file = nullptr;
+    int width = 0, height = 0, rows = 0;
+    int level = Z_DEFAULT_COMPRESSION;
+    uLong adler = 1; // of everything deflated so far
+    std::vector<unsigned char> previous, out;
+    std::vector<Chunk> chunks;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "cpu_renderer.h"
+
+// palette_color() (palette_pass.frag's lookup) and to_rgb8() for whole runs
+// of escape values, with the colors split into one array per channel so the
+// vector kernels can gather them.
+struct RecolorPalette {
+    std::vector<float> r, g, b;
+    int iterations = 0;
+    bool smooth = true;
+
+    RecolorPalette(const std::vector<glm::vec3>& colors, int iterations, bool smooth);
+};
+
+using RecolorFn = void (*)(const RecolorPalette& palette, const float* escape, int count, unsigned char* rgb);
+
+// bit-identical to palette_color + to_rgb8 on every kernel
+RecolorFn cpu_recolor(CpuKernel kernel);
+
+// `mandelbrot --recolor in.escape out.png [--palette file]`: colors an
+// escape file (escape_file.h) with the palette it was exported with, or the
+// palette_state (and time) of a json file such as mandelconfig.
+// `threads` = 0 is one per core. Returns false on error.
+bool recolor_escape_file(const std::string& input, const std::string& output, const char* palette_file, int threads);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+// What a pass reads, as bits. A pass runs in a frame when one of its inputs
+// changed since it last ran, when the pass it reads from ran, or when it
+// asked for another frame (a progressive level, more samples to average).
+enum RenderInput : unsigned {
+    INPUT_CAMERA     = 1 << 0, // center, zoom, and renderer settings that change the escape values
+    INPUT_ITERATIONS = 1 << 1,
+    INPUT_PALETTE    = 1 << 2, // palette parameters and smooth coloring
+    INPUT_TIME       = 1 << 3, // only while the palette is animated
+    INPUT_WINDOW     = 1 << 4,
+    INPUT_QUALITY    = 1 << 5, // antialiasing and accumulation settings
+    INPUT_UI         = 1 << 6, // the imgui overlay
+    INPUT_ALL        = (1 << 7) - 1,
+};
+
+// The frame as a chain of passes, each one skipped when nothing it reads
+// changed. When no pass is left to run the main loop can sleep until the
+// next event instead of redrawing the same image.
+class RenderGraph {
+public:
+    // `inputs` is RenderInput bits, `reads` the pass whose output it uses
+    // (-1 for none), which has to be added and begun before it
+    int add_pass(const char* name, unsigned inputs, int reads = -1);
+
+    // these inputs changed, the passes reading any of them run next
+    void invalidate(unsigned inputs);
+    // `pass` has work left and runs again at its next begin()
+    void request(int pass);
+
+    // call once per frame for every pass, in the order they were added.
+    // true if the pass runs this frame, then passes reading it run too.
+    bool begin(int pass);
+    // the inputs that made it run, 0 if it only runs for upstream work or a request
+    unsigned changed(int pass) const { return passes[pass].changed; }
+    bool ran(int pass) const { return passes[pass].ran; }
+
+    // nothing to run, the next frame would look the same
+    bool idle() const;
+    const char* name(int pass) const { return passes[pass].name; }
+
+private:
+    struct Pass {
+        const char* name;
+        unsigned inputs;
+        int reads;
+        unsigned pending = 0; // inputs changed since it last ran
+        unsigned changed = 0;
+        bool requested = false;
+        bool ran = false;
+    };
+    std::vector<Pass> passes;
+};
@@ -4,10 +4,15 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <algorithm>
+#include <cmath>
 #include <unordered_map>
 #include <filesystem>
 #include "shader.h"
+#include "cpu_renderer.h"
+#include "perturbation.h"
 #include <nlohmann/json.hpp>
+#include "imgui.h"
 
 struct ChannelState {
     glm::vec3 color = {0.0f, 0.0f, 0.0f};
@@ -17,9 +22,11 @@ struct ChannelState {
     float x_scale = 0.3f;
     float t_scale = 0.5f;
     bool show_controls = true;
-    float operator()(float iteration) {
-        return y_scale * (0.5f + 0.5f * glm::cos(x_offset + iteration * x_scale + t_scale * ImGui::GetTime()));
+    // at `time` seconds into the animation (headless renders have no ImGui clock)
+    float at(float iteration, float time) const {
+        return y_scale * (0.5f + 0.5f * glm::cos(x_offset + iteration * x_scale + t_scale * time));
     }
+    float operator()(float iteration) { return at(iteration, ImGui::GetTime()); }
 };
 struct PaletteState {
     std::unordered_map<std::string, ChannelState> channels;
@@ -30,10 +37,35 @@ struct PaletteState {
 };
 struct AppState {
     int width = 1200, height = 900;
-    double camera_x = -0.65, camera_y = 0.0, zoom = 0.5;
+    double camera_x = -0.65, camera_y = 0.0;
+    FloatExp zoom = 0.5; // may go far past 1e308, use zoom.to_double() for shallow paths
+    // full-precision camera, camera_x/y are its nearest doubles.
+    // change both through pan_camera()/set_camera().
+    BigFixed center_x{-0.65}, center_y{0.0};
+    bool deep_zoom = false; // perturbation even when doubles would do
     int max_iterations = 150;
     bool auto_zoom_in = false, auto_zoom_out = false;
-    bool show_ui = true, use_ssaa = true;
+    bool show_ui = true;
+    // extra samples only for pixels on an edge, see adaptive_aa.h
+    bool antialias = true;
+    int aa_samples = 8; // per edge pixel, 2..64
+    float aa_threshold = 0.08f; // color difference to a neighbour that makes an edge
+    // while the camera is still, average one more jittered frame each frame
+    bool accumulate = true;
+    int accumulate_samples = 64; // frames until the mean is left alone, 16..256
+    // spread the gpu fractal pass over frames, at most this much gpu time each
+    bool time_slice = true;
+    float gpu_budget_ms = 8.0f;
+    bool use_cpu = false; // compute the escape buffer on the cpu instead of fractal_pass.frag
+    Numeric cpu_numeric = Numeric::Auto;
+    bool use_compute = false; // fractal_compute.comp instead of drawing fractal_pass.frag
+    bool progressive = true; // 1/8 resolution first after a camera change, refined over the next frames
+    bool mariani_silver = false; // only iterate rectangle borders, fill the uniform ones
+    int ms_guard = 1; // extra border rings that have to agree before a fill
+    bool ms_verify = false; // also brute-force every frame and count differing pixels
+    // escape tiles of finished views kept on disk, see tile_cache.h
+    bool tile_cache = true;
+    int tile_cache_mb = 512; // read at startup
     bool dirty_fractal = true;
     PaletteState palette_state;
 
@@ -49,6 +81,23 @@ struct AppState {
     void mark_dirty() { dirty_fractal = true; }
 };
 
+// fractal_pass.frag variants, cheapest first
+enum class ShaderPrecision {
+    Float,
+    FloatFloat,
+    Double,
+};
+
+// Camera the escape buffer was last fully rendered with, so a pan can shift
+// it and only compute the strips that came into view.
+struct EscapeBufferView {
+    bool valid = false;
+    BigFixed center_x, center_y;
+    FloatExp zoom;
+    int width = 0, height = 0, iterations = 0;
+    int pass = -1; // which renderer filled it, see main()
+};
+
 struct App {
     GLFWwindow* window = nullptr;
     AppState state;
@@ -62,7 +111,27 @@ void load_state(App& app, const std::filesystem::path& path);
 void save_state(App& app, const std::filesystem::path& path);
 
 void update_camera(App& app);
+void pan_camera(AppState& state, const FloatExp& dx, const FloatExp& dy);
+void set_camera(AppState& state, double x, double y);
+bool use_perturbation(const AppState& state);
+// whole escape-buffer pixels the camera moved since `from`; false when the
+// buffer can't be reused (zoom/size/iterations changed, or a sub-pixel move)
+bool pixel_shift(const AppState& state, const EscapeBufferView& from, int width, int height, int& dx, int& dy);
+// maps the current view's pos onto `from`'s (old pos = pos * xy + zw), for
+// reproject_pass.frag; false when too little of the old image would be reused
+bool reprojection(const AppState& state, const EscapeBufferView& from, int width, int height, float transform[4]);
+// rows the escape samples have to resolve, 2x the window's since the
+// antialiasing samples fall between them
+int supersampled_height(const AppState& state);
+ShaderPrecision shader_precision(const AppState& state);
+const char* shader_precision_name(ShaderPrecision precision);
 void update_uniforms(App& app, ShaderProgram& sp);
+void update_perturbation_uniforms(App& app, ShaderProgram& sp, const ReferenceOrbit& ref);
+void update_level_uniforms(ShaderProgram& sp, int step, int width, int height, bool refine, bool reproject = false);
+// full resolution, every fragment (dx, dy) pixels off its center
+void update_jitter_uniforms(ShaderProgram& sp, double dx, double dy, int width, int height);
+EscapeView escape_view(const AppState& state);
+DeepView deep_view(const AppState& state, const ReferenceOrbit& ref);
 void imgui_camera_ui(App& app);
 
 bool is_pressed(GLFWwindow* window, int key);
@@ -129,27 +198,72 @@ inline void to_json(nlohmann::json& j, const AppState& s) {
         {"height", s.height},
         {"camera_x", s.camera_x},
         {"camera_y", s.camera_y},
-        {"zoom", s.zoom},
+        {"camera_x_hp", s.center_x.to_string()},
+        {"camera_y_hp", s.center_y.to_string()},
+        {"zoom_hp", s.zoom.to_string()},
+        {"deep_zoom", s.deep_zoom},
         {"max_iterations", s.max_iterations},
         // {"auto_zoom_in", s.auto_zoom_in},
         // {"auto_zoom_out", s.auto_zoom_out},
         {"show_ui", s.show_ui},
-        {"use_ssaa", s.use_ssaa},
+        {"antialias", s.antialias},
+        {"aa_samples", s.aa_samples},
+        {"aa_threshold", s.aa_threshold},
+        {"accumulate", s.accumulate},
+        {"accumulate_samples", s.accumulate_samples},
+        {"time_slice", s.time_slice},
+        {"gpu_budget_ms", s.gpu_budget_ms},
+        {"use_cpu", s.use_cpu},
+        {"cpu_numeric", (int)s.cpu_numeric},
+        {"use_compute", s.use_compute},
+        {"progressive", s.progressive},
+        {"mariani_silver", s.mariani_silver},
+        {"ms_guard", s.ms_guard},
+        {"ms_verify", s.ms_verify},
+        {"tile_cache", s.tile_cache},
+        {"tile_cache_mb", s.tile_cache_mb},
         // {"dirty_fractal", s.dirty_fractal},
         {"palette_state", s.palette_state},
         // {"pan_speed", s.pan_speed},
         // {"zoom_speed", s.zoom_speed}
     };
+    // plain double for older builds, when it fits
+    if (std::isfinite(s.zoom.to_double())) j["zoom"] = s.zoom.to_double();
 }
 inline void from_json(const nlohmann::json& j, AppState& s) {
     s.width = j.value("width", s.width);
     s.height = j.value("height", s.height);
     s.camera_x = j.value("camera_x", s.camera_x);
     s.camera_y = j.value("camera_y", s.camera_y);
-    s.zoom = j.value("zoom", s.zoom);
+    s.zoom = j.value("zoom", s.zoom.to_double());
+    if (j.contains("zoom_hp")) FloatExp::parse(j.at("zoom_hp").get<std::string>(), s.zoom);
+    s.deep_zoom = j.value("deep_zoom", s.deep_zoom);
+    int limbs = frac_limbs_for_zoom(s.zoom);
+    s.center_x = BigFixed(s.camera_x, limbs);
+    s.center_y = BigFixed(s.camera_y, limbs);
+    // a malformed or out of range _hp string leaves the center from the double
+    if (j.contains("camera_x_hp")) BigFixed::parse(j.at("camera_x_hp").get<std::string>(), limbs, s.center_x);
+    if (j.contains("camera_y_hp")) BigFixed::parse(j.at("camera_y_hp").get<std::string>(), limbs, s.center_y);
+    s.camera_x = s.center_x.to_double();
+    s.camera_y = s.center_y.to_double();
     s.max_iterations = j.value("max_iterations", s.max_iterations);
     s.show_ui = j.value("show_ui", s.show_ui);
-    s.use_ssaa = j.value("use_ssaa", s.use_ssaa);
+    s.antialias = j.value("antialias", s.antialias);
+    s.aa_samples = std::clamp(j.value("aa_samples", s.aa_samples), 2, 64);
+    s.aa_threshold = j.value("aa_threshold", s.aa_threshold);
+    s.accumulate = j.value("accumulate", s.accumulate);
+    s.accumulate_samples = std::clamp(j.value("accumulate_samples", s.accumulate_samples), 16, 256);
+    s.time_slice = j.value("time_slice", s.time_slice);
+    s.gpu_budget_ms = std::clamp(j.value("gpu_budget_ms", s.gpu_budget_ms), 1.0f, 100.0f);
+    s.use_cpu = j.value("use_cpu", s.use_cpu);
+    s.cpu_numeric = (Numeric)j.value("cpu_numeric", (int)s.cpu_numeric);
+    s.use_compute = j.value("use_compute", s.use_compute);
+    s.progressive = j.value("progressive", s.progressive);
+    s.mariani_silver = j.value("mariani_silver", s.mariani_silver);
+    s.ms_guard = j.value("ms_guard", s.ms_guard);
+    s.ms_verify = j.value("ms_verify", s.ms_verify);
+    s.tile_cache = j.value("tile_cache", s.tile_cache);
+    s.tile_cache_mb = std::clamp(j.value("tile_cache_mb", s.tile_cache_mb), 16, 1 << 20);
     if (j.contains("palette_state")) {
         s.palette_state = j.at("palette_state").get<PaletteState>();
     }
@@ -1,7 +1,16 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+// A program built from embedded sources. link() only starts the work: the
+// binary is loaded from the on-disk cache if a matching one is there,
+// otherwise the stages are compiled, which drivers with
+// KHR_parallel_shader_compile do on their own threads. So several programs
+// can be linked back to back and waited for afterwards with linked().
 class ShaderProgram {
 public:
     GLuint id;
@@ -13,9 +22,34 @@ public:
     ShaderProgram& operator=(const ShaderProgram& other) = delete;
     ~ShaderProgram();
 
+    // programs linked from then on are stored in (and loaded from) `dir`,
+    // keyed by their sources and the driver. An empty path turns it off.
+    static void set_binary_cache(const std::filesystem::path& dir);
+
+    // kept until link(), compile errors show up in linked()
     bool attach_from_string(GLenum shader_type, const char* source);
     void link();
+    // waits for link() to finish, prints the compile or link log if it
+    // failed. use() and uniform_location() wait too.
+    bool linked();
     void use();
 
+    // from a table read once after linking, -1 like glGetUniformLocation
+    // for names the program doesn't use
     GLint uniform_location(const GLchar *name);
+
+private:
+    struct Stage {
+        GLenum type;
+        std::string source;
+        GLuint shader = 0;
+    };
+    std::vector<Stage> stages;
+    std::unordered_map<std::string, GLint> uniforms;
+    unsigned long long key = 0; // of the sources and the driver
+    bool started = false, finished = false, ok = false, from_cache = false;
+
+    bool compile_log(const Stage& stage);
+    void load_uniforms();
+    void store_binary();
 };
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cmath>
+
+// Lane packs for the CPU escape kernels. Every pack exposes the same small
+// interface so one kernel template can be instantiated per instruction set
+// and element type:
+//   width, Elem, Mask, broadcast ctor, ramp(), load(), + - * and unary -, fms(),
+//   operator>, select(), any(), mask_and(), mask_andnot(), store().
+// The AVX packs only exist in translation units compiled for that ISA.
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+template <class T>
+struct ScalarPackT {
+    static constexpr int width = 1;
+    using Elem = T;
+    using Mask = bool;
+    T v;
+
+    ScalarPackT() = default;
+    ScalarPackT(T x) : v(x) {}
+    // base + (first + lane) * step, rounded the same way in every pack
+    static ScalarPackT ramp(T base, T step, int first) { return base + T(first) * step; }
+    static ScalarPackT load(const T* p) { return p[0]; }
+    static Mask all_true() { return true; }
+    void store(T* out) const { out[0] = v; }
+};
+template <class T> inline ScalarPackT<T> operator+(ScalarPackT<T> a, ScalarPackT<T> b) { return a.v + b.v; }
+template <class T> inline ScalarPackT<T> operator-(ScalarPackT<T> a, ScalarPackT<T> b) { return a.v - b.v; }
+template <class T> inline ScalarPackT<T> operator-(ScalarPackT<T> a) { return -a.v; }
+template <class T> inline ScalarPackT<T> operator*(ScalarPackT<T> a, ScalarPackT<T> b) { return a.v * b.v; }
+template <class T> inline bool operator>(ScalarPackT<T> a, ScalarPackT<T> b) { return a.v > b.v; }
+template <class T> inline ScalarPackT<T> select(bool m, ScalarPackT<T> a, ScalarPackT<T> b) { return m ? a : b; }
+// exact a*b - p for p = a*b. Dekker's split, the scalar path can't assume an fma unit.
+template <class T> inline ScalarPackT<T> fms(ScalarPackT<T> a, ScalarPackT<T> b, ScalarPackT<T> p) {
+    const T split = sizeof(T) == 8 ? T(134217729.0) : T(4097.0); // 2^27+1, 2^12+1
+    T ta = split * a.v, tb = split * b.v;
+    T ah = ta - (ta - a.v), al = a.v - ah;
+    T bh = tb - (tb - b.v), bl = b.v - bh;
+    return ((ah * bh - p.v) + ah * bl + al * bh) + al * bl;
+}
+inline bool any(bool m) { return m; }
+inline bool mask_and(bool a, bool b) { return a && b; }
+inline bool mask_andnot(bool a, bool b) { return !a && b; } // ~a & b
+
+using ScalarPack = ScalarPackT<double>;
+using ScalarPackF = ScalarPackT<float>;
+
+#if defined(__AVX2__)
+struct Avx2Pack {
+    static constexpr int width = 4;
+    using Elem = double;
+    using Mask = __m256d;
+    __m256d v;
+
+    Avx2Pack() = default;
+    Avx2Pack(__m256d x) : v(x) {}
+    Avx2Pack(double x) : v(_mm256_set1_pd(x)) {}
+    static Avx2Pack ramp(double base, double step, int first) {
+        __m256d idx = _mm256_add_pd(_mm256_set1_pd(first), _mm256_set_pd(3, 2, 1, 0));
+        return _mm256_add_pd(_mm256_set1_pd(base), _mm256_mul_pd(idx, _mm256_set1_pd(step)));
+    }
+    static Avx2Pack load(const double* p) { return _mm256_loadu_pd(p); }
+    static Mask all_true() { return _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); }
+    void store(double* out) const { _mm256_storeu_pd(out, v); }
+};
+inline Avx2Pack operator+(Avx2Pack a, Avx2Pack b) { return _mm256_add_pd(a.v, b.v); }
+inline Avx2Pack operator-(Avx2Pack a, Avx2Pack b) { return _mm256_sub_pd(a.v, b.v); }
+inline Avx2Pack operator-(Avx2Pack a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline Avx2Pack operator*(Avx2Pack a, Avx2Pack b) { return _mm256_mul_pd(a.v, b.v); }
+inline Avx2Pack fms(Avx2Pack a, Avx2Pack b, Avx2Pack p) { return _mm256_fmsub_pd(a.v, b.v, p.v); }
+inline __m256d operator>(Avx2Pack a, Avx2Pack b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+inline Avx2Pack select(__m256d m, Avx2Pack a, Avx2Pack b) { return _mm256_blendv_pd(b.v, a.v, m); }
+inline bool any(__m256d m) { return _mm256_movemask_pd(m) != 0; }
+inline __m256d mask_and(__m256d a, __m256d b) { return _mm256_and_pd(a, b); }
+inline __m256d mask_andnot(__m256d a, __m256d b) { return _mm256_andnot_pd(a, b); }
+
+struct Avx2PackF {
+    static constexpr int width = 8;
+    using Elem = float;
+    using Mask = __m256;
+    __m256 v;
+
+    Avx2PackF() = default;
+    Avx2PackF(__m256 x) : v(x) {}
+    Avx2PackF(float x) : v(_mm256_set1_ps(x)) {}
+    static Avx2PackF ramp(float base, float step, int first) {
+        __m256 idx = _mm256_add_ps(_mm256_set1_ps((float)first), _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0));
+        return _mm256_add_ps(_mm256_set1_ps(base), _mm256_mul_ps(idx, _mm256_set1_ps(step)));
+    }
+    static Avx2PackF load(const float* p) { return _mm256_loadu_ps(p); }
+    static Mask all_true() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    void store(float* out) const { _mm256_storeu_ps(out, v); }
+};
+inline Avx2PackF operator+(Avx2PackF a, Avx2PackF b) { return _mm256_add_ps(a.v, b.v); }
+inline Avx2PackF operator-(Avx2PackF a, Avx2PackF b) { return _mm256_sub_ps(a.v, b.v); }
+inline Avx2PackF operator-(Avx2PackF a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline Avx2PackF operator*(Avx2PackF a, Avx2PackF b) { return _mm256_mul_ps(a.v, b.v); }
+inline Avx2PackF fms(Avx2PackF a, Avx2PackF b, Avx2PackF p) { return _mm256_fmsub_ps(a.v, b.v, p.v); }
+inline __m256 operator>(Avx2PackF a, Avx2PackF b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Avx2PackF select(__m256 m, Avx2PackF a, Avx2PackF b) { return _mm256_blendv_ps(b.v, a.v, m); }
+inline bool any(__m256 m) { return _mm256_movemask_ps(m) != 0; }
+inline __m256 mask_and(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+inline __m256 mask_andnot(__m256 a, __m256 b) { return _mm256_andnot_ps(a, b); }
+#endif
+
+#if defined(__AVX512F__)
+struct Avx512Pack {
+    static constexpr int width = 8;
+    using Elem = double;
+    using Mask = __mmask8;
+    __m512d v;
+
+    Avx512Pack() = default;
+    Avx512Pack(__m512d x) : v(x) {}
+    Avx512Pack(double x) : v(_mm512_set1_pd(x)) {}
+    static Avx512Pack ramp(double base, double step, int first) {
+        __m512d idx = _mm512_add_pd(_mm512_set1_pd(first), _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0));
+        return _mm512_add_pd(_mm512_set1_pd(base), _mm512_mul_pd(idx, _mm512_set1_pd(step)));
+    }
+    static Avx512Pack load(const double* p) { return _mm512_loadu_pd(p); }
+    static Mask all_true() { return 0xFF; }
+    void store(double* out) const { _mm512_storeu_pd(out, v); }
+};
+inline Avx512Pack operator+(Avx512Pack a, Avx512Pack b) { return _mm512_add_pd(a.v, b.v); }
+inline Avx512Pack operator-(Avx512Pack a, Avx512Pack b) { return _mm512_sub_pd(a.v, b.v); }
+inline Avx512Pack operator-(Avx512Pack a) { return _mm512_sub_pd(_mm512_setzero_pd(), a.v); }
+inline Avx512Pack operator*(Avx512Pack a, Avx512Pack b) { return _mm512_mul_pd(a.v, b.v); }
+inline Avx512Pack fms(Avx512Pack a, Avx512Pack b, Avx512Pack p) { return _mm512_fmsub_pd(a.v, b.v, p.v); }
+inline __mmask8 operator>(Avx512Pack a, Avx512Pack b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ); }
+inline Avx512Pack select(__mmask8 m, Avx512Pack a, Avx512Pack b) { return _mm512_mask_blend_pd(m, b.v, a.v); }
+inline bool any(__mmask8 m) { return m != 0; }
+inline __mmask8 mask_and(__mmask8 a, __mmask8 b) { return a & b; }
+inline __mmask8 mask_andnot(__mmask8 a, __mmask8 b) { return ~a & b; }
+
+struct Avx512PackF {
+    static constexpr int width = 16;
+    using Elem = float;
+    using Mask = __mmask16;
+    __m512 v;
+
+    Avx512PackF() = default;
+    Avx512PackF(__m512 x) : v(x) {}
+    Avx512PackF(float x) : v(_mm512_set1_ps(x)) {}
+    static Avx512PackF ramp(float base, float step, int first) {
+        __m512 idx = _mm512_add_ps(_mm512_set1_ps((float)first),
+                                   _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+        return _mm512_add_ps(_mm512_set1_ps(base), _mm512_mul_ps(idx, _mm512_set1_ps(step)));
+    }
+    static Avx512PackF load(const float* p) { return _mm512_loadu_ps(p); }
+    static Mask all_true() { return 0xFFFF; }
+    void store(float* out) const { _mm512_storeu_ps(out, v); }
+};
+inline Avx512PackF operator+(Avx512PackF a, Avx512PackF b) { return _mm512_add_ps(a.v, b.v); }
+inline Avx512PackF operator-(Avx512PackF a, Avx512PackF b) { return _mm512_sub_ps(a.v, b.v); }
+inline Avx512PackF operator-(Avx512PackF a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+inline Avx512PackF operator*(Avx512PackF a, Avx512PackF b) { return _mm512_mul_ps(a.v, b.v); }
+inline Avx512PackF fms(Avx512PackF a, Avx512PackF b, Avx512PackF p) { return _mm512_fmsub_ps(a.v, b.v, p.v); }
+inline __mmask16 operator>(Avx512PackF a, Avx512PackF b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+inline Avx512PackF select(__mmask16 m, Avx512PackF a, Avx512PackF b) { return _mm512_mask_blend_ps(m, b.v, a.v); }
+inline bool any(__mmask16 m) { return m != 0; }
+inline __mmask16 mask_and(__mmask16 a, __mmask16 b) { return a & b; }
+inline __mmask16 mask_andnot(__mmask16 a, __mmask16 b) { return ~a & b; }
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cpu_renderer.h"
+
+// Persistent pyramid of escape tiles, so views that were seen before come
+// back without iterating. Level L splits the plane into tiles of
+// TILE_SIZE^2 escape values, 4 / 2^L wide, tile (0, 0) at the origin:
+// sample (i, j) of tile (tx, ty) is c = ((tx * TILE_SIZE + i + 0.5) * q, ...)
+// with q = 4 / (TILE_SIZE * 2^L).
+//
+// Tiles live in one memory-mapped file: a header, an index of fixed slots
+// (key and last use), then the slots' data. When it's full the least
+// recently used tile makes room. Only double-range zooms are cached; past
+// that the tile coordinates would need BigFixed keys.
+//
+// A view is filled from the level whose spacing is the largest at or
+// below its pixel size, each pixel taking the nearest cached sample (less
+// than half a pixel off its center, like a jittered render). Missing tiles
+// are computed on the cpu by a background thread.
+class TileCache {
+public:
+    static constexpr int TILE_SIZE = 256;
+    static constexpr int MAX_LEVEL = 40;
+
+    TileCache() = default;
+    TileCache(const TileCache& other) = delete;
+    TileCache& operator=(const TileCache& other) = delete;
+    ~TileCache();
+
+    // maps `path`, holding at most `max_bytes` of tiles. A file written
+    // with another size is started over.
+    bool open(const std::filesystem::path& path, size_t max_bytes);
+    void close();
+    bool is_open() const { return base != nullptr; }
+
+    // The width x height escape buffer of `view` (rows from the bottom) from
+    // cached tiles. False, leaving `out` alone, if any of them is missing.
+    bool sample(const EscapeView& view, int width, int height, float* out);
+    // computes the missing tiles of `view` in the background, dropping
+    // whatever an earlier call still had queued
+    void prefetch(const EscapeView& view, int width, int height);
+
+    int tiles() const;
+    int capacity() const { return slots; }
+    int queued() const;
+
+private:
+    struct Key {
+        int32_t level, iterations, numeric;
+        int64_t tx, ty;
+        bool operator==(const Key& o) const {
+            return level == o.level && iterations == o.iterations && numeric == o.numeric && tx == o.tx && ty == o.ty;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    struct Header;
+    struct Entry;
+    // the tiles covering a view, and the level / sample spacing they're on
+    struct Cover {
+        int level;
+        double spacing;
+        int64_t tx0, ty0, tx1, ty1;
+        std::vector<Key> keys;
+    };
+
+    static size_t data_offset(int slots); // where the tiles start, page aligned
+    bool cover(const EscapeView& view, int width, int height, Cover& c) const;
+    Entry* entry(int slot) const;
+    float* data(int slot) const;
+    // slot for a new tile, evicting the least recently used one
+    int claim();
+    void worker_loop();
+
+    // the mapping
+    unsigned char* base = nullptr;
+    size_t mapped_bytes = 0;
+    int slots = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    mutable std::mutex mutex;
+    std::unordered_map<Key, int, KeyHash> index;
+
+    // background fill
+    std::thread worker;
+    std::condition_variable wake;
+    std::vector<std::pair<Key, EscapeView>> wanted; // popped from the back
+    bool quit = false;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+    int x0, y0, w, h;
+};
+
+// how long one tile took, for load-balance diagnostics and tile size adaptation
+struct TileStats {
+    Tile tile;
+    double ms;
+    int worker;
+};
+
+// Splits a width x height target into square tiles and runs them on a pool of
+// persistent workers. Each worker owns a deque (pops its own back, steals from
+// the front of the others), so rows through the set interior that cost
+// max_iterations per pixel don't leave the other cores idle.
+class TileScheduler {
+public:
+    using TileFn = std::function<void(const Tile&)>;
+
+    explicit TileScheduler(int num_threads = 0); // 0 = hardware concurrency
+    TileScheduler(const TileScheduler& other) = delete;
+    TileScheduler& operator=(const TileScheduler& other) = delete;
+    ~TileScheduler();
+
+    // Blocks until `fn` has run for every tile. The calling thread works too.
+    void run(int width, int height, const TileFn& fn);
+
+    int num_threads() const { return (int)queues.size(); }
+    int tile_size() const { return size; }
+    // fixes the tile size; pass 0 to go back to adapting it from tile costs
+    void set_tile_size(int tile_size);
+    const std::vector<TileStats>& last_stats() const { return stats; }
+    double last_run_ms() const { return run_ms; }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+
+    void worker_loop(int worker);
+    void drain(int worker);
+    bool pop(int worker, int& tile);
+    bool steal(int worker, int& tile);
+    void adapt();
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<Tile> tiles;
+    std::vector<TileStats> stats;
+    const TileFn* job = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    uint64_t generation = 0;
+    int active_workers = 0;
+    bool quit = false;
+
+    int size = 64;
+    bool adaptive = true;
+    double run_ms = 0.0;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glad/glad.h>
+#include "tile_scheduler.h"
+
+// Spreads one fragment pass over several frames. The regions to draw are cut
+// into scissored tiles and each frame issues only as many as are expected to
+// fit a gpu time budget; the expectation comes from timer queries on earlier
+// batches, read back without stalling once the gpu has finished them.
+class TimeSlicer {
+public:
+    using DrawFn = std::function<void()>;
+
+    TimeSlicer();
+    TimeSlicer(const TimeSlicer& other) = delete;
+    TimeSlicer& operator=(const TimeSlicer& other) = delete;
+    ~TimeSlicer();
+
+    // replaces the queue with `regions` in tiles, the ones nearest to
+    // (center_x, center_y) first
+    void start(const std::vector<Tile>& regions, int center_x, int center_y);
+    // draws queued tiles until the estimate reaches budget_ms, at least one.
+    // the target, program and uniforms must already be bound
+    void run(double budget_ms, const DrawFn& draw);
+    void cancel() { queue.clear(); next = 0; }
+
+    bool pending() const { return next < queue.size(); }
+    int tiles_left() const { return (int)(queue.size() - next); }
+    // gpu time of the last measured batch
+    double last_gpu_ms() const { return gpu_ms; }
+
+private:
+    void collect();
+
+    static constexpr int QUERIES = 4; // batches in flight
+    std::vector<Tile> queue;
+    size_t next = 0;
+    GLuint queries[QUERIES];
+    long long query_pixels[QUERIES] = {}; // 0 = free
+    int query_next = 0;
+    double ns_per_pixel = 0.0; // 0 until the first batch is measured
+    double gpu_ms = 0.0;
+};
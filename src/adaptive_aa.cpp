@@ -0,0 +1,170 @@
+#include "adaptive_aa.h"
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "shaders/aa_edge_pass.frag"
+
+// escape count jump that is an edge whatever the palette does there
+static constexpr float GRADIENT_THRESHOLD = 2.0f;
+
+static GLuint create_texture() {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+AdaptiveAA::AdaptiveAA()
+    : edge_mask(1, 1, FrameBuffer::Format::R32F, false), sample_buffer(1, 1, FrameBuffer::Format::R32F, false) {
+    index_texture = create_texture();
+    pos_texture = create_texture();
+}
+
+AdaptiveAA::~AdaptiveAA() {
+    glDeleteTextures(1, &index_texture);
+    glDeleteTextures(1, &pos_texture);
+}
+
+bool AdaptiveAA::init(const char* vertex_source) {
+    if (!edge_program.attach_from_string(GL_VERTEX_SHADER, vertex_source)) return false;
+    if (!edge_program.attach_from_string(GL_FRAGMENT_SHADER, aa_edge_pass_shader_str)) return false;
+    edge_program.link();
+    if (!edge_program.linked()) {
+        std::cerr << "Linking the antialiasing edge pass failed" << std::endl;
+        return false;
+    }
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    return true;
+}
+
+// R2 low-discrepancy sequence, so any sample count covers the pixel evenly
+void AdaptiveAA::sample_offset(int k, double& dx, double& dy) {
+    double x = 0.5 + k * 0.7548776662466927, y = 0.5 + k * 0.5698402909980532;
+    dx = x - std::floor(x) - 0.5;
+    dy = y - std::floor(y) - 0.5;
+}
+
+int AdaptiveAA::find_edges(FrameBuffer& escape, FrameBuffer& colors, int new_width, int new_height, int iterations,
+                           float threshold, int new_samples) {
+    width = new_width;
+    height = new_height;
+    samples = new_samples;
+
+    edge_mask.resize(width, height);
+    edge_mask.bind();
+    glViewport(0, 0, width, height);
+    edge_program.use();
+    glActiveTexture(GL_TEXTURE0);
+    escape.bind_texture();
+    glActiveTexture(GL_TEXTURE1);
+    colors.bind_texture();
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(edge_program.uniform_location("escape"), 0);
+    glUniform1i(edge_program.uniform_location("colors"), 1);
+    glUniform1i(edge_program.uniform_location("iterations"), iterations);
+    glUniform1f(edge_program.uniform_location("threshold"), threshold);
+    glUniform1f(edge_program.uniform_location("gradient_threshold"), GRADIENT_THRESHOLD);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    edge_mask.unbind();
+
+    // compact the edges into a list on the cpu, it's one readback per finished frame
+    mask.resize((size_t)width * height);
+    edge_mask.download(mask.data());
+    std::vector<float> index(mask.size(), -1.0f);
+    edge_pixels.clear();
+    for (size_t i = 0; i < mask.size(); i++) {
+        if (mask[i] < 0.5f) continue;
+        index[i] = (float)edge_pixels.size(); // exact below 2^24 pixels
+        edge_pixels.push_back((int)i);
+    }
+
+    // the list is a texture too, with fewer samples per pixel when they don't fit
+    // (the edges always do at 1 extra, there are no more than the window has pixels)
+    size_t capacity = (size_t)max_texture_size * max_texture_size;
+    if (!edge_pixels.empty() && edge_pixels.size() * (samples - 1) > capacity) {
+        samples = 1 + (int)(capacity / edge_pixels.size());
+        std::cerr << "AA: " << edge_pixels.size() << " edge pixels, lowered to " << samples << " samples each" << std::endl;
+    }
+    int extra = samples - 1;
+    size_t total = edge_pixels.size() * extra;
+    list_width = (int)std::clamp<size_t>(total, 1, max_texture_size);
+    list_height = (int)std::max<size_t>(1, (total + list_width - 1) / list_width);
+    std::vector<float> pos((size_t)2 * list_width * list_height, 0.0f);
+    for (size_t e = 0; e < edge_pixels.size(); e++) {
+        int x = edge_pixels[e] % width, y = edge_pixels[e] / width;
+        for (int k = 1; k < samples; k++) {
+            double dx, dy;
+            sample_offset(k, dx, dy);
+            size_t t = e * extra + k - 1;
+            pos[2 * t] = (float)(2.0 * (x + 0.5 + dx) / width - 1.0);
+            pos[2 * t + 1] = (float)(2.0 * (y + 0.5 + dy) / height - 1.0);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, index_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, index.data());
+    glBindTexture(GL_TEXTURE_2D, pos_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, list_width, list_height, 0, GL_RG, GL_FLOAT, pos.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    sample_buffer.resize(list_width, list_height);
+    return edges();
+}
+
+void AdaptiveAA::render_samples(ShaderProgram& sp) {
+    sample_buffer.bind();
+    glViewport(0, 0, list_width, list_height);
+    sp.use();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, pos_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(sp.uniform_location("refine"), false);
+    glUniform1i(sp.uniform_location("reproject"), false);
+    glUniform1i(sp.uniform_location("sample_list"), true);
+    glUniform1i(sp.uniform_location("sample_pos"), 1);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glUniform1i(sp.uniform_location("sample_list"), false);
+    sample_buffer.unbind();
+}
+
+void AdaptiveAA::render_samples(const EscapeView& view, TileScheduler& scheduler) {
+    CpuKernel kernel = cpu_detect_kernel();
+    std::vector<float> image((size_t)width * height);
+    std::vector<float> list((size_t)list_width * list_height, 0.0f);
+    int extra = samples - 1;
+    for (int k = 1; k < samples; k++) {
+        EscapeView jittered = view;
+        sample_offset(k, jittered.jitter_x, jittered.jitter_y);
+        // the edge pixels of each row, in runs
+        scheduler.run(width, height, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y0 + t.h; y++) {
+                const float* row = mask.data() + (size_t)y * width;
+                for (int x = t.x0; x < t.x0 + t.w;) {
+                    if (row[x] < 0.5f) { x++; continue; }
+                    int end = x;
+                    while (end < t.x0 + t.w && row[end] >= 0.5f) end++;
+                    cpu_render_rect(jittered, kernel, image.data(), width, height, x, y, end - x, 1);
+                    x = end;
+                }
+            }
+        });
+        for (size_t e = 0; e < edge_pixels.size(); e++) list[e * extra + k - 1] = image[edge_pixels[e]];
+    }
+    sample_buffer.upload(list.data());
+}
+
+void AdaptiveAA::bind(ShaderProgram& palette_program) {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, index_texture);
+    glActiveTexture(GL_TEXTURE3);
+    sample_buffer.bind_texture();
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(palette_program.uniform_location("edgeIndex"), 2);
+    glUniform1i(palette_program.uniform_location("samples"), 3);
+    glUniform1i(palette_program.uniform_location("sampleCount"), samples);
+}
@@ -0,0 +1,321 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "batch.h"
+#include "bounded_queue.h"
+#include "exp_map.h"
+#include "palette.h"
+#include "tile_scheduler.h"
+
+using json = nlohmann::json;
+
+int Animation::frame_count() const {
+    if (keyframes.empty()) return 0;
+    return (int)std::floor(keyframes.back().at * fps + 1e-6) + 1;
+}
+
+bool load_animation(const std::filesystem::path& path, const AppState& base, Animation& anim) {
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open animation file: " << path << std::endl;
+        return false;
+    }
+    try {
+        json data = json::parse(f);
+        anim.fps = std::max(1, data.value("fps", anim.fps));
+        anim.output = data.value("output", anim.output);
+        anim.format = data.value("format", anim.format);
+        anim.exp_map = data.value("exp_map", anim.exp_map);
+        if (anim.format != "y4m" && anim.format != "raw") {
+            std::cerr << path << ": unknown format " << anim.format << ", use y4m or raw" << std::endl;
+            return false;
+        }
+        json merged = base;
+        if (data.contains("defaults")) merge_state_json(merged, data.at("defaults"));
+        for (const json& k : data.at("keyframes")) {
+            merge_state_json(merged, k);
+            AnimationKeyframe key;
+            key.at = k.at("at").get<double>();
+            key.state = merged.get<AppState>();
+            key.state.use_cpu = true;
+            key.time = merged.value("time", 0.0f);
+            default_channels(key.state.palette_state);
+            anim.keyframes.push_back(std::move(key));
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Error parsing animation file " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+    if (anim.keyframes.empty()) {
+        std::cerr << path << ": no keyframes" << std::endl;
+        return false;
+    }
+    std::stable_sort(anim.keyframes.begin(), anim.keyframes.end(),
+                     [](const AnimationKeyframe& a, const AnimationKeyframe& b) { return a.at < b.at; });
+    for (AnimationKeyframe& key : anim.keyframes) {
+        key.state.width = anim.keyframes[0].state.width;
+        key.state.height = anim.keyframes[0].state.height;
+    }
+    return anim.keyframes[0].state.width > 0 && anim.keyframes[0].state.height > 0;
+}
+
+AppState animation_state(const Animation& anim, double t, float& palette_time) {
+    const std::vector<AnimationKeyframe>& keys = anim.keyframes;
+    size_t k = 0;
+    while (k + 2 < keys.size() && t >= keys[k + 1].at) k++;
+    const AnimationKeyframe& a = keys[k];
+    if (keys.size() == 1 || t <= a.at) {
+        palette_time = a.time;
+        return a.state;
+    }
+    const AnimationKeyframe& b = keys[k + 1];
+    double s = b.at > a.at ? std::clamp((t - a.at) / (b.at - a.at), 0.0, 1.0) : 1.0;
+
+    AppState state = a.state; // everything but the camera, iterations and time steps at keyframes
+    double l0 = a.state.zoom.log2(), l1 = b.state.zoom.log2();
+    double l = l0 + (l1 - l0) * s;
+    state.zoom = FloatExp::from_log2(l);
+
+    // with r = zoom0/zoom, the camera covers (1 - r) / (1 - r1) of the way:
+    // the target's distance from the center in pixels then shrinks steadily
+    double r1 = std::exp2(l0 - l1), w = s;
+    if (std::abs(l1 - l0) > 1e-9) w = (1.0 - std::exp2(l0 - l)) / (1.0 - r1);
+    int limbs = std::max({frac_limbs_for_zoom(state.zoom), a.state.center_x.frac_limbs(), b.state.center_x.frac_limbs()});
+    BigFixed dx = b.state.center_x - a.state.center_x, dy = b.state.center_y - a.state.center_y;
+    // the step only has a double's digits, so measure it from the nearer end
+    if (w < 0.5) {
+        state.center_x = a.state.center_x + BigFixed(dx.to_floatexp() * w, limbs);
+        state.center_y = a.state.center_y + BigFixed(dy.to_floatexp() * w, limbs);
+    } else {
+        state.center_x = b.state.center_x - BigFixed(dx.to_floatexp() * (1.0 - w), limbs);
+        state.center_y = b.state.center_y - BigFixed(dy.to_floatexp() * (1.0 - w), limbs);
+    }
+    state.camera_x = state.center_x.to_double();
+    state.camera_y = state.center_y.to_double();
+    state.max_iterations = (int)std::lround(a.state.max_iterations + (b.state.max_iterations - a.state.max_iterations) * s);
+    palette_time = (float)(a.time + (b.time - a.time) * s);
+    return state;
+}
+
+// max_iterations of a frame at `zoom`: interpolated like animation_state()
+// does, on the first keyframe pair whose zooms bracket it
+static int iterations_at_zoom(const Animation& anim, const FloatExp& zoom) {
+    const std::vector<AnimationKeyframe>& keys = anim.keyframes;
+    double l = zoom.log2();
+    for (size_t k = 0; k + 1 < keys.size(); k++) {
+        double l0 = keys[k].state.zoom.log2(), l1 = keys[k + 1].state.zoom.log2();
+        if (l < std::min(l0, l1) || l > std::max(l0, l1)) continue;
+        double s = l1 != l0 ? (l - l0) / (l1 - l0) : 1.0;
+        int i0 = keys[k].state.max_iterations, i1 = keys[k + 1].state.max_iterations;
+        return (int)std::lround(i0 + (i1 - i0) * s);
+    }
+    // outside every pair, the keyframe closest in zoom
+    const AnimationKeyframe* best = &keys[0];
+    for (const AnimationKeyframe& key : keys) {
+        if (std::abs(key.state.zoom.log2() - l) < std::abs(best->state.zoom.log2() - l)) best = &key;
+    }
+    return best->state.max_iterations;
+}
+
+struct AnimationFrame {
+    int index = 0;
+    AppState state;
+    CpuCamera camera;
+    std::vector<glm::vec3> colors, rgb;
+    std::vector<float> escape, sample_escapes;
+    std::vector<int> edges;
+    std::vector<unsigned char> data; // what goes into the file
+};
+using FramePtr = std::unique_ptr<AnimationFrame>;
+
+static void color_lookup(AnimationFrame& f) {
+    f.rgb.resize(f.escape.size());
+    for (size_t i = 0; i < f.escape.size(); i++) {
+        f.rgb[i] = palette_color(f.escape[i], f.state.max_iterations, f.colors, f.state.palette_state.use_smooth);
+    }
+}
+
+static unsigned char to_byte(float v) { return (unsigned char)std::clamp((int)(v * 255.0f + 0.5f), 0, 255); }
+
+// full-range BT.601 (C420jpeg), chroma the mean of each 2x2 block.
+// escape rows count from the bottom, video rows from the top
+static void to_yuv420(const glm::vec3* rgb, int width, int height, std::vector<unsigned char>& out) {
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    out.resize((size_t)width * height + 2 * (size_t)cw * ch);
+    unsigned char* y_plane = out.data();
+    unsigned char* u_plane = y_plane + (size_t)width * height;
+    unsigned char* v_plane = u_plane + (size_t)cw * ch;
+    for (int y = 0; y < height; y++) {
+        const glm::vec3* row = rgb + (size_t)(height - 1 - y) * width;
+        for (int x = 0; x < width; x++) {
+            y_plane[(size_t)y * width + x] = to_byte(0.299f * row[x].x + 0.587f * row[x].y + 0.114f * row[x].z);
+        }
+    }
+    for (int y = 0; y < ch; y++) {
+        const glm::vec3* r0 = rgb + (size_t)(height - 1 - 2 * y) * width;
+        const glm::vec3* r1 = rgb + (size_t)(height - 1 - std::min(2 * y + 1, height - 1)) * width;
+        for (int x = 0; x < cw; x++) {
+            int x1 = std::min(2 * x + 1, width - 1);
+            glm::vec3 a = r0[2 * x], b = r0[x1], c = r1[2 * x], d = r1[x1];
+            float r = (a.x + b.x + c.x + d.x) * 0.25f, g = (a.y + b.y + c.y + d.y) * 0.25f, bl = (a.z + b.z + c.z + d.z) * 0.25f;
+            u_plane[(size_t)y * cw + x] = to_byte(0.5f - 0.168736f * r - 0.331264f * g + 0.5f * bl);
+            v_plane[(size_t)y * cw + x] = to_byte(0.5f + 0.5f * r - 0.418688f * g - 0.081312f * bl);
+        }
+    }
+}
+
+static void to_rgb24(const glm::vec3* rgb, int width, int height, std::vector<unsigned char>& out) {
+    out.resize((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        to_rgb8(rgb + (size_t)(height - 1 - y) * width, width, out.data() + (size_t)y * width * 3);
+    }
+}
+
+bool render_animation(Animation& anim, int threads) {
+    int frames = anim.frame_count();
+    int width = anim.keyframes[0].state.width, height = anim.keyframes[0].state.height;
+    bool y4m = anim.format == "y4m";
+
+    FILE* out = stdout;
+    if (anim.output == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    } else {
+        std::error_code ec;
+        std::filesystem::path parent = std::filesystem::path(anim.output).parent_path();
+        if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+        out = std::fopen(anim.output.c_str(), "wb");
+        if (!out) {
+            std::cerr << "Failed to open " << anim.output << " for writing" << std::endl;
+            return false;
+        }
+    }
+    if (y4m) std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, anim.fps);
+
+    TileScheduler scheduler(threads);
+    // exp_map: every point of the zoom computed up front, frames are resampled from it
+    ExpMap map;
+    if (anim.exp_map) {
+        auto t0 = std::chrono::steady_clock::now();
+        const AnimationKeyframe* deepest = &anim.keyframes[0];
+        FloatExp zoom_min = deepest->state.zoom;
+        for (const AnimationKeyframe& key : anim.keyframes) {
+            if (key.state.zoom < zoom_min) zoom_min = key.state.zoom;
+            if (key.state.zoom > deepest->state.zoom) deepest = &key;
+        }
+        map.build(deepest->state.center_x, deepest->state.center_y, zoom_min, deepest->state.zoom, width, height,
+                  [&](const FloatExp& zoom) { return iterations_at_zoom(anim, zoom); }, scheduler);
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cerr << "exp map: " << map.points() << " points (" << (double)map.points() / ((double)width * height)
+                  << " frames' worth) in " << s << " s" << std::endl;
+    }
+
+    // two frames waiting per stage: enough to ride out uneven frame costs,
+    // and memory stays at a handful of frames
+    BoundedQueue<FramePtr> planned(2), computed(2), colored(2);
+    auto start = std::chrono::steady_clock::now();
+
+    // plan: camera and palette per frame. A new reference orbit is only
+    // computed when the last one stops covering the view, and it overlaps
+    // with the previous frame's compute.
+    std::thread plan([&] {
+        std::shared_ptr<const ReferenceOrbit> reference;
+        for (int i = 0; i < frames; i++) {
+            auto f = std::make_unique<AnimationFrame>();
+            f->index = i;
+            float time;
+            f->state = animation_state(anim, (double)i / anim.fps, time);
+            if (!anim.exp_map) {
+                f->camera.setup(f->state, reference);
+                reference = f->camera.reference;
+            }
+            palette_colors(f->state.palette_state, f->state.max_iterations + 1, time, f->colors);
+            if (!planned.push(std::move(f))) break;
+        }
+        planned.close();
+    });
+    // compute: escape values on every core, plus the antialiasing samples
+    // (finding the edges needs the colors). From an exp map, straight to colors.
+    std::thread compute([&] {
+        FramePtr f;
+        while (planned.pop(f)) {
+            if (anim.exp_map) {
+                const AppState& state = f->state;
+                f->rgb.resize((size_t)width * height);
+                map.resample(state.zoom, state.max_iterations, f->colors, state.palette_state.use_smooth,
+                             state.antialias ? state.aa_samples : 1, f->rgb.data(), scheduler);
+                if (!computed.push(std::move(f))) break;
+                continue;
+            }
+            f->escape.resize((size_t)width * height);
+            f->camera.render(f->escape.data(), 0, 0, width, height, scheduler);
+            const AppState& state = f->state;
+            if (state.antialias && state.aa_samples > 1) {
+                color_lookup(*f);
+                find_aa_edges(state, f->escape.data(), f->rgb.data(), width, height, 0, 0, width, height, f->edges);
+                sample_aa_edges(f->camera, state.aa_samples, f->edges, 0, 0, width, scheduler, f->sample_escapes);
+            }
+            if (!computed.push(std::move(f))) break;
+        }
+        computed.close();
+    });
+    // color: palette, antialiasing, then the output pixel format
+    std::thread color([&] {
+        FramePtr f;
+        while (computed.pop(f)) {
+            const AppState& state = f->state;
+            if (f->rgb.empty()) color_lookup(*f);
+            if (state.antialias && state.aa_samples > 1) {
+                resolve_aa_edges(state, f->colors, state.aa_samples, f->edges, f->sample_escapes, f->rgb.data());
+            }
+            if (y4m) to_yuv420(f->rgb.data(), width, height, f->data);
+            else to_rgb24(f->rgb.data(), width, height, f->data);
+            // only the bytes go on
+            std::vector<float>().swap(f->escape);
+            std::vector<glm::vec3>().swap(f->rgb);
+            if (!colored.push(std::move(f))) break;
+        }
+        colored.close();
+    });
+
+    // write, on this thread. Progress goes to stderr, stdout may be the video
+    bool ok = true;
+    int written = 0;
+    FramePtr f;
+    while (colored.pop(f)) {
+        if ((y4m && std::fputs("FRAME\n", out) == EOF) || std::fwrite(f->data.data(), 1, f->data.size(), out) != f->data.size()) {
+            std::cerr << "Failed to write frame " << f->index << " to " << anim.output << std::endl;
+            ok = false;
+            break;
+        }
+        written++;
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "\rframe " << written << "/" << frames << " (" << written / s << " fps)" << std::flush;
+    }
+    // a failed write stops the stages upstream, their pushes return false
+    planned.close();
+    computed.close();
+    colored.close();
+    plan.join();
+    compute.join();
+    color.join();
+
+    if (std::fflush(out) != 0) ok = false;
+    if (out != stdout && std::fclose(out) != 0) ok = false;
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << std::endl << written << " frames in " << s << " s" << std::endl;
+    return ok && written == frames;
+}
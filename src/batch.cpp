@@ -0,0 +1,346 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "png_stream.h"
+#include "escape_file.h"
+#include "export_journal.h"
+#include "palette.h"
+#include "adaptive_aa.h"
+#include "tile_scheduler.h"
+
+using json = nlohmann::json;
+
+// a plain camera_x/zoom in a job has to win over the _hp strings it inherits
+void merge_state_json(json& into, const json& patch) {
+    for (const char* key : {"camera_x", "camera_y", "zoom"}) {
+        if (patch.contains(key) && !patch.contains(std::string(key) + "_hp")) into.erase(std::string(key) + "_hp");
+    }
+    into.merge_patch(patch);
+}
+
+// relative cost of one iteration in each numeric type, from --bench
+static double iteration_cost(const AppState& state) {
+    if (use_perturbation(state)) return 6.0;
+    switch (state.cpu_numeric == Numeric::Auto ? select_numeric(state.zoom.to_double(), state.height) : state.cpu_numeric) {
+        case Numeric::Float: return 0.5;
+        case Numeric::DoubleDouble: return 8.0;
+        case Numeric::QuadDouble: return 80.0;
+        default: return 1.0;
+    }
+}
+
+bool load_jobs(const std::filesystem::path& path, const AppState& base, std::vector<BatchJob>& jobs) {
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open job file: " << path << std::endl;
+        return false;
+    }
+    try {
+        json data = json::parse(f);
+        json defaults = base;
+        if (data.is_object()) {
+            if (data.contains("defaults")) merge_state_json(defaults, data.at("defaults"));
+            data = data.at("jobs");
+        }
+        for (const json& j : data) {
+            json merged = defaults;
+            merge_state_json(merged, j);
+            BatchJob job;
+            job.state = merged.get<AppState>();
+            // the cpu decides when perturbation kicks in, see use_perturbation()
+            job.state.use_cpu = true;
+            job.output = j.at("output").get<std::string>();
+            job.escape_output = j.value("escape", "");
+            job.time = merged.value("time", 0.0f);
+            job.tile = std::max(16, merged.value("tile", job.tile));
+            job.checkpoint = merged.value("checkpoint", job.checkpoint);
+            default_channels(job.state.palette_state);
+            // edges are around a tenth of the pixels
+            double aa = job.state.antialias ? 1.0 + 0.1 * (job.state.aa_samples - 1) : 1.0;
+            job.cost = (double)job.state.width * job.state.height * aa * job.state.max_iterations * iteration_cost(job.state);
+            jobs.push_back(std::move(job));
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Error parsing job file " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void to_rgb8(const glm::vec3* rgb, size_t count, unsigned char* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[3 * i + 0] = (unsigned char)std::clamp((int)(rgb[i].x * 255.0f + 0.5f), 0, 255);
+        out[3 * i + 1] = (unsigned char)std::clamp((int)(rgb[i].y * 255.0f + 0.5f), 0, 255);
+        out[3 * i + 2] = (unsigned char)std::clamp((int)(rgb[i].z * 255.0f + 0.5f), 0, 255);
+    }
+}
+
+// palette_pass.frag on the cpu: the 1D texture lookup with GL's filtering and clamp-to-edge
+glm::vec3 palette_color(float escape, int iterations, const std::vector<glm::vec3>& colors, bool smooth) {
+    int n = (int)colors.size();
+    float t = (escape - 0.5f) / float(iterations + 1);
+    if (!smooth) return colors[std::clamp((int)std::floor(t * n), 0, n - 1)];
+    float u = t * n - 0.5f;
+    float fl = std::floor(u), f = u - fl;
+    const glm::vec3& a = colors[std::clamp((int)fl, 0, n - 1)];
+    const glm::vec3& b = colors[std::clamp((int)fl + 1, 0, n - 1)];
+    return {a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f, a.z + (b.z - a.z) * f};
+}
+
+// everything the pixels depend on; a journal written for other values is thrown away
+static json job_params(const BatchJob& job) {
+    json all = job.state;
+    json params;
+    for (const char* key : {"width", "height", "camera_x_hp", "camera_y_hp", "zoom_hp", "deep_zoom", "max_iterations",
+                            "cpu_numeric", "antialias", "aa_samples", "aa_threshold", "palette_state"}) {
+        params[key] = all[key];
+    }
+    params["time"] = job.time;
+    params["tile"] = job.tile;
+    return params;
+}
+
+void CpuCamera::setup(const AppState& state, std::shared_ptr<const ReferenceOrbit> previous) {
+    width = state.width;
+    height = state.height;
+    deep = use_perturbation(state);
+    reference = nullptr;
+    if (deep) {
+        if (!previous || reference_is_stale(*previous, state.center_x, state.center_y, state.zoom, state.max_iterations)) {
+            auto orbit = std::make_shared<ReferenceOrbit>();
+            compute_reference_orbit(*orbit, state.center_x, state.center_y, state.zoom, state.max_iterations);
+            previous = orbit;
+        }
+        reference = previous;
+        deep_view = ::deep_view(state, *reference);
+    } else {
+        view = escape_view(state);
+    }
+}
+
+// the image seen through a window whose pixel (0, 0) is image pixel (x0, y0)
+template <class View> static View windowed(View view, int width, int height, int x0, int y0) {
+    view.image_width = width;
+    view.image_height = height;
+    view.origin_x = x0;
+    view.origin_y = y0;
+    return view;
+}
+
+void CpuCamera::render(float* out, int x0, int y0, int w, int h, TileScheduler& scheduler) const {
+    if (deep) cpu_render_perturbed(*reference, windowed(deep_view, width, height, x0, y0), out, w, h, scheduler);
+    else cpu_render_escape(windowed(view, width, height, x0, y0), out, w, h, scheduler);
+}
+
+float CpuCamera::sample(int x, int y, double dx, double dy) const {
+    float v;
+    if (deep) {
+        DeepView v1 = windowed(deep_view, width, height, x, y);
+        v1.jitter_x = dx;
+        v1.jitter_y = dy;
+        cpu_render_perturbed(*reference, v1, &v, 1, 1, 0, 0, 1, 1);
+    } else {
+        EscapeView v1 = windowed(view, width, height, x, y);
+        v1.jitter_x = dx;
+        v1.jitter_y = dy;
+        cpu_render_rect(v1, cpu_detect_kernel(), &v, 1, 1, 0, 0, 1, 1);
+    }
+    return v;
+}
+
+void find_aa_edges(const AppState& state, const float* escape, const glm::vec3* rgb, int aw, int ah, int x0, int y0,
+                   int w, int h, std::vector<int>& edges) {
+    const float GRADIENT_THRESHOLD = 2.0f; // as in adaptive_aa.cpp
+    int iterations = state.max_iterations;
+    auto differs = [&](int a, int b) {
+        float ea = escape[a], eb = escape[b];
+        bool inside_a = ea >= float(iterations + 1), inside_b = eb >= float(iterations + 1);
+        if (inside_a != inside_b) return true;
+        if (!inside_a && std::abs(ea - eb) > GRADIENT_THRESHOLD) return true;
+        const glm::vec3 &ca = rgb[a], &cb = rgb[b];
+        return std::max({std::abs(ca.x - cb.x), std::abs(ca.y - cb.y), std::abs(ca.z - cb.z)}) > state.aa_threshold;
+    };
+    edges.clear();
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            int i = y * aw + x;
+            // neighbours past the window are the pixel itself, like the shader's clamp
+            if ((x > 0 && differs(i, i - 1)) || (x < aw - 1 && differs(i, i + 1)) ||
+                (y > 0 && differs(i, i - aw)) || (y < ah - 1 && differs(i, i + aw))) {
+                edges.push_back(i);
+            }
+        }
+    }
+}
+
+void sample_aa_edges(const CpuCamera& camera, int samples, const std::vector<int>& edges, int ax0, int ay0, int aw,
+                     TileScheduler& scheduler, std::vector<float>& out) {
+    out.resize(edges.size() * (samples - 1));
+    // the edge list as a 1-row "image" for the scheduler's workers
+    scheduler.run((int)edges.size(), 1, [&](const Tile& t) {
+        for (int e = t.x0; e < t.x0 + t.w; e++) {
+            for (int k = 1; k < samples; k++) {
+                double dx, dy;
+                AdaptiveAA::sample_offset(k, dx, dy);
+                out[(size_t)e * (samples - 1) + k - 1] = camera.sample(ax0 + edges[e] % aw, ay0 + edges[e] / aw, dx, dy);
+            }
+        }
+    });
+}
+
+void resolve_aa_edges(const AppState& state, const std::vector<glm::vec3>& colors, int samples, const std::vector<int>& edges,
+                      const std::vector<float>& sample_escapes, glm::vec3* rgb) {
+    for (size_t e = 0; e < edges.size(); e++) {
+        glm::vec3 sum = rgb[edges[e]];
+        for (int k = 0; k < samples - 1; k++) {
+            glm::vec3 c = palette_color(sample_escapes[e * (samples - 1) + k], state.max_iterations, colors,
+                                        state.palette_state.use_smooth);
+            sum = {sum.x + c.x, sum.y + c.y, sum.z + c.z};
+        }
+        rgb[edges[e]] = {sum.x / samples, sum.y / samples, sum.z / samples};
+    }
+}
+
+// whatever a worker keeps between jobs
+struct BatchWorker {
+    TileScheduler scheduler;
+    CpuCamera camera;
+    std::vector<float> escape, sample_escapes;
+    std::vector<glm::vec3> rgb, colors;
+    std::vector<int> edges;
+    std::vector<unsigned char> band;
+    // the finished tile, rows from the bottom
+    std::vector<float> tile_escape;
+    std::vector<unsigned char> tile_rgb;
+
+    explicit BatchWorker(int threads) : scheduler(threads) {}
+};
+
+// Renders tile [x0, x0+tw) x [y0, y0+th) into tile_escape and tile_rgb.
+// The tile is computed with a 1px apron so the antialiasing edge test
+// (aa_edge_pass.frag) sees the same neighbours as it would in the whole image.
+static void render_tile(BatchJob& job, BatchWorker& w, int x0, int y0, int tw, int th) {
+    const AppState& state = job.state;
+    int ax0 = std::max(0, x0 - 1), ay0 = std::max(0, y0 - 1);
+    int aw = std::min(state.width, x0 + tw + 1) - ax0, ah = std::min(state.height, y0 + th + 1) - ay0;
+    w.escape.resize((size_t)aw * ah);
+    w.camera.render(w.escape.data(), ax0, ay0, aw, ah, w.scheduler);
+    w.rgb.resize(w.escape.size());
+    for (size_t i = 0; i < w.escape.size(); i++) {
+        w.rgb[i] = palette_color(w.escape[i], state.max_iterations, w.colors, state.palette_state.use_smooth);
+    }
+    if (state.antialias && state.aa_samples > 1) {
+        find_aa_edges(state, w.escape.data(), w.rgb.data(), aw, ah, x0 - ax0, y0 - ay0, tw, th, w.edges);
+        sample_aa_edges(w.camera, state.aa_samples, w.edges, ax0, ay0, aw, w.scheduler, w.sample_escapes);
+        resolve_aa_edges(state, w.colors, state.aa_samples, w.edges, w.sample_escapes, w.rgb.data());
+    }
+
+    w.tile_escape.resize((size_t)tw * th);
+    w.tile_rgb.resize((size_t)tw * th * 3);
+    for (int y = 0; y < th; y++) {
+        size_t from = (size_t)(y0 + y - ay0) * aw + (x0 - ax0);
+        std::copy_n(w.escape.data() + from, tw, w.tile_escape.data() + (size_t)y * tw);
+        to_rgb8(w.rgb.data() + from, tw, w.tile_rgb.data() + (size_t)y * tw * 3);
+    }
+}
+
+// Tiles of job.tile pixels, one band of them at a time streamed into the
+// png, so memory is one band of 8-bit pixels however large the image is.
+static bool render_job(BatchJob& job, BatchWorker& w) {
+    AppState& state = job.state;
+    int width = state.width, height = state.height;
+    if (width <= 0 || height <= 0) {
+        std::cerr << job.output << ": bad resolution " << width << "x" << height << std::endl;
+        return false;
+    }
+    palette_colors(state.palette_state, state.max_iterations + 1, job.time, w.colors);
+    w.camera.setup(state, w.camera.reference);
+
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(job.output).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    ExportJournal journal;
+    bool checkpoint = job.checkpoint && journal.open(job.output, job_params(job).dump());
+    if (checkpoint && journal.resumed_tiles() > 0) {
+        std::cout << job.output << ": resuming, " << journal.resumed_tiles() << " tiles done" << std::endl;
+    }
+    PngStream png;
+    if (!png.open(job.output, width, height)) return false;
+    EscapeFileWriter escape;
+    if (!job.escape_output.empty() &&
+        !escape.open(job.escape_output, width, height, job.tile, state.max_iterations, job_params(job))) {
+        return false;
+    }
+    // the png goes top to bottom, escape rows count from the bottom.
+    // resumed tiles are only read back and encoded again
+    for (int top = 0; top < height; top += job.tile) {
+        int band_height = std::min(job.tile, height - top);
+        int y0 = height - top - band_height;
+        w.band.resize((size_t)width * band_height * 3);
+        for (int x0 = 0; x0 < width; x0 += job.tile) {
+            int tile_width = std::min(job.tile, width - x0);
+            w.tile_escape.resize((size_t)tile_width * band_height);
+            w.tile_rgb.resize((size_t)tile_width * band_height * 3);
+            if (!checkpoint || !journal.load(x0, y0, tile_width, band_height, w.tile_escape.data(), w.tile_rgb.data())) {
+                render_tile(job, w, x0, y0, tile_width, band_height);
+                if (checkpoint) journal.append(x0, y0, tile_width, band_height, w.tile_escape.data(), w.tile_rgb.data());
+            }
+            if (!job.escape_output.empty() &&
+                !escape.write_tile(x0 / job.tile, top / job.tile, tile_width, band_height, w.tile_escape.data())) {
+                return false;
+            }
+            for (int y = 0; y < band_height; y++) {
+                std::copy_n(w.tile_rgb.data() + (size_t)y * tile_width * 3, tile_width * 3,
+                            w.band.data() + ((size_t)(band_height - 1 - y) * width + x0) * 3);
+            }
+        }
+        if (!png.write_rows(w.band.data(), band_height, &w.scheduler)) return false;
+    }
+    if (!png.close()) return false;
+    if (!job.escape_output.empty() && !escape.close()) return false;
+    if (checkpoint) journal.finish();
+    return true;
+}
+
+int run_batch(std::vector<BatchJob>& jobs, int workers) {
+    if (jobs.empty()) return 0;
+    if (workers <= 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    // with fewer jobs than cores, each job gets several threads instead
+    int threads_per_job = std::max(1, workers / (int)jobs.size());
+    workers = std::min(workers, (int)jobs.size());
+
+    // longest processing time first: the big ones can't end up last on a lone worker
+    std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.cost > b.cost; });
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0}, done{0};
+    std::mutex log;
+    auto start = std::chrono::steady_clock::now();
+    auto work = [&] {
+        BatchWorker worker(threads_per_job);
+        for (size_t i; (i = next++) < jobs.size();) {
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = render_job(jobs[i], worker);
+            if (!ok) failed++;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            std::lock_guard<std::mutex> lock(log);
+            std::cout << "[" << ++done << "/" << jobs.size() << "] " << jobs[i].output << (ok ? "" : " FAILED") << " ("
+                      << (int)ms << " ms)" << std::endl;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workers; i++) threads.emplace_back(work);
+    work();
+    for (std::thread& t : threads) t.join();
+
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << jobs.size() << " jobs in " << s << " s, " << failed << " failed" << std::endl;
+    return failed;
+}
@@ -0,0 +1,41 @@
+#include "compute_pass.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "shaders/fractal_compute.comp"
+
+// enough workgroups to fill any current gpu; the rest of the tiles are
+// handed out through the counter
+static constexpr GLuint PERSISTENT_GROUPS = 256;
+static constexpr int TILE_SIZE = 16; // local_size in the shader
+
+ComputePass::ComputePass() { glGenBuffers(1, &counter); }
+ComputePass::~ComputePass() { glDeleteBuffers(1, &counter); }
+
+bool ComputePass::init() {
+    if (!program.attach_from_string(GL_COMPUTE_SHADER, fractal_compute_str)) return false;
+    program.link();
+    if (!program.linked()) {
+        std::cerr << "Linking the compute pass failed" << std::endl;
+        return false;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
+
+void ComputePass::dispatch(GLuint texture, int width, int height) {
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counter);
+    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    GLuint tiles = (GLuint)(((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE));
+    glDispatchCompute(std::min(tiles, PERSISTENT_GROUPS), 1, 1);
+    // the palette pass samples the image next
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
@@ -0,0 +1,204 @@
+#include "cpu_renderer.h"
+#include "simd.h"
+#include "escape_kernel.h"
+#include "tile_scheduler.h"
+
+#if defined(_MSC_VER) && defined(MANDEL_X86_KERNELS)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#ifdef MANDEL_X86_KERNELS
+// defined in escape_avx2.cpp / escape_avx512.cpp, which get their own arch flags
+extern const EscapeSpanFn escape_spans_avx2[4];
+extern const EscapeSpanFn escape_spans_avx512[4];
+extern const EscapeColumnFn escape_columns_avx2[4];
+extern const EscapeColumnFn escape_columns_avx512[4];
+#endif
+
+static const EscapeSpanFn escape_spans_scalar[4] = ESCAPE_SPAN_TABLE(ScalarPack, ScalarPackF);
+static const EscapeColumnFn escape_columns_scalar[4] = ESCAPE_COLUMN_TABLE(ScalarPack, ScalarPackF);
+
+// extra bits on top of the pixel spacing, for rounding error that the
+// iteration amplifies
+static constexpr int GUARD_BITS = 10;
+
+#if defined(MANDEL_X86_KERNELS) && defined(_MSC_VER)
+static bool os_saves_ymm_zmm(bool zmm) {
+    int info[4];
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) return false; // OSXSAVE
+    unsigned long long xcr0 = _xgetbv(0);
+    unsigned long long need = zmm ? 0xE6 : 0x06;
+    return (xcr0 & need) == need;
+}
+#endif
+
+CpuKernel cpu_detect_kernel() {
+#if defined(MANDEL_X86_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return CpuKernel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CpuKernel::AVX2;
+#elif defined(MANDEL_X86_KERNELS) && defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    bool avx512f = info[1] & (1 << 16);
+    if (avx512f && os_saves_ymm_zmm(true)) return CpuKernel::AVX512;
+    if (avx2 && os_saves_ymm_zmm(false)) return CpuKernel::AVX2;
+#endif
+    return CpuKernel::Scalar;
+}
+
+const char* cpu_kernel_name(CpuKernel kernel) {
+    switch (kernel) {
+        case CpuKernel::AVX512: return "AVX-512";
+        case CpuKernel::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+EscapeSpanFn cpu_escape_span(CpuKernel kernel, Numeric numeric) {
+    int index = numeric == Numeric::Auto ? 1 : (int)numeric - 1;
+    switch (kernel) {
+#ifdef MANDEL_X86_KERNELS
+        case CpuKernel::AVX512: return escape_spans_avx512[index];
+        case CpuKernel::AVX2: return escape_spans_avx2[index];
+#endif
+        default: return escape_spans_scalar[index];
+    }
+}
+
+EscapeColumnFn cpu_escape_column(CpuKernel kernel, Numeric numeric) {
+    int index = numeric == Numeric::Auto ? 1 : (int)numeric - 1;
+    switch (kernel) {
+#ifdef MANDEL_X86_KERNELS
+        case CpuKernel::AVX512: return escape_columns_avx512[index];
+        case CpuKernel::AVX2: return escape_columns_avx2[index];
+#endif
+        default: return escape_columns_scalar[index];
+    }
+}
+
+const char* numeric_name(Numeric numeric) {
+    switch (numeric) {
+        case Numeric::Float: return "float";
+        case Numeric::Double: return "double";
+        case Numeric::DoubleDouble: return "double-double";
+        case Numeric::QuadDouble: return "quad-double";
+        default: return "auto";
+    }
+}
+
+int numeric_bits(Numeric numeric) {
+    switch (numeric) {
+        case Numeric::Float: return 24;
+        case Numeric::Double: return 53;
+        case Numeric::DoubleDouble: return 106;
+        case Numeric::QuadDouble: return 212;
+        default: return 0;
+    }
+}
+
+bool mantissa_resolves(int bits, double zoom, int height) {
+    // pixels are 2/(zoom*height) apart on coordinates of magnitude ~2
+    return std::log2(zoom * height) + GUARD_BITS <= bits;
+}
+
+bool numeric_resolves(Numeric numeric, double zoom, int height) {
+    return mantissa_resolves(numeric_bits(numeric), zoom, height);
+}
+
+Numeric select_numeric(double zoom, int height) {
+    // never below double: the cpu stands in for fractal_pass.frag and has to match it
+    for (Numeric n : {Numeric::Double, Numeric::DoubleDouble}) {
+        if (numeric_resolves(n, zoom, height)) return n;
+    }
+    return Numeric::QuadDouble;
+}
+
+// parts of `camera + offset` as a 4-term sum
+static void offset_parts(double camera, const double* tail, double offset, double* parts) {
+    using Q = QD<ScalarPack>;
+    Q sum = Q(camera) + Q(tail[0]) + Q(tail[1]) + Q(tail[2]) + Q(offset);
+    for (int i = 0; i < 4; i++) parts[i] = sum.x[i].v;
+}
+
+void cpu_render_rect(const EscapeView& view, CpuKernel kernel, float* out, int width, int height,
+                     int x0, int y0, int w, int h) {
+    int image_width = view.image_width ? view.image_width : width;
+    int image_height = view.image_height ? view.image_height : height;
+    Numeric numeric = view.numeric == Numeric::Auto ? select_numeric(view.zoom, image_height) : view.numeric;
+    EscapeSpanFn span = cpu_escape_span(kernel, numeric);
+    // pos is the fragment center in [-1, 1], same mapping as main() in the shader
+    double scale_x = 1.0 / view.zoom * view.aspect;
+    double scale_y = 1.0 / view.zoom;
+    double re_step = 2.0 / image_width * scale_x;
+    double re0[4], im[4];
+    // image column 0, so a window's pixels come out bit-identical to the whole image's
+    offset_parts(view.camera_x, view.camera_x_tail, ((2.0 * view.jitter_x + 1.0) / image_width - 1.0) * scale_x, re0);
+    for (int y = y0; y < y0 + h; y++) {
+        offset_parts(view.camera_y, view.camera_y_tail, ((2.0 * (view.origin_y + y + view.jitter_y) + 1.0) / image_height - 1.0) * scale_y, im);
+        span(re0, re_step, im, view.origin_x + x0, w, view.max_iterations, out + (size_t)y * width + x0);
+    }
+}
+
+void cpu_render_column(const EscapeView& view, CpuKernel kernel, float* out, int width, int height,
+                       int x, int y0, int h) {
+    int image_width = view.image_width ? view.image_width : width;
+    int image_height = view.image_height ? view.image_height : height;
+    Numeric numeric = view.numeric == Numeric::Auto ? select_numeric(view.zoom, image_height) : view.numeric;
+    EscapeColumnFn column = cpu_escape_column(kernel, numeric);
+    double scale_x = 1.0 / view.zoom * view.aspect;
+    double scale_y = 1.0 / view.zoom;
+    double re_step = 2.0 / image_width * scale_x;
+    double re0[4];
+    offset_parts(view.camera_x, view.camera_x_tail, ((2.0 * view.jitter_x + 1.0) / image_width - 1.0) * scale_x, re0);
+    std::vector<double> im((size_t)4 * h);
+    for (int y = y0; y < y0 + h; y++) {
+        offset_parts(view.camera_y, view.camera_y_tail, ((2.0 * (view.origin_y + y + view.jitter_y) + 1.0) / image_height - 1.0) * scale_y, &im[4 * (y - y0)]);
+    }
+    column(re0, re_step, view.origin_x + x, im.data(), h, view.max_iterations, out + (size_t)y0 * width + x, width);
+}
+
+void cpu_render_escape(const EscapeView& view, float* out, int width, int height) {
+    cpu_render_rect(view, cpu_detect_kernel(), out, width, height, 0, 0, width, height);
+}
+
+void cpu_render_escape(const EscapeView& view, float* out, int width, int height, TileScheduler& scheduler) {
+    CpuKernel kernel = cpu_detect_kernel();
+    scheduler.run(width, height, [&](const Tile& t) {
+        cpu_render_rect(view, kernel, out, width, height, t.x0, t.y0, t.w, t.h);
+    });
+}
+
+void cpu_print_benchmark() {
+    // seahorse valley: mostly slow-escaping pixels, few that never escape
+    EscapeView view;
+    view.camera_x = -0.7436;
+    view.camera_y = 0.1318;
+    view.zoom = 200.0;
+    view.max_iterations = 1000;
+    const int width = 320, height = 240;
+    std::vector<float> out((size_t)width * height);
+
+    std::printf("%-8s %-14s %10s %10s\n", "kernel", "numeric", "Mpix/s", "Miter/s");
+    int best = (int)cpu_detect_kernel();
+    for (int k = 0; k <= best; k++) {
+        for (int n = (int)Numeric::Float; n <= (int)Numeric::QuadDouble; n++) {
+            view.numeric = (Numeric)n;
+            auto start = std::chrono::steady_clock::now();
+            cpu_render_rect(view, (CpuKernel)k, out.data(), width, height, 0, 0, width, height);
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double iters = 0.0;
+            for (float v : out) iters += std::min((double)v, (double)view.max_iterations);
+            std::printf("%-8s %-14s %10.2f %10.1f\n", cpu_kernel_name((CpuKernel)k), numeric_name((Numeric)n),
+                        width * height / s * 1e-6, iters / s * 1e-6);
+        }
+    }
+}
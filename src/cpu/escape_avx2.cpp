@@ -0,0 +1,7 @@
+// compiled with -mavx2 -mfma (or /arch:AVX2), see CMakeLists.txt
+#include "cpu_renderer.h"
+#include "escape_kernel.h"
+
+// indexed by Numeric - 1
+extern const EscapeSpanFn escape_spans_avx2[4] = ESCAPE_SPAN_TABLE(Avx2Pack, Avx2PackF);
+extern const EscapeColumnFn escape_columns_avx2[4] = ESCAPE_COLUMN_TABLE(Avx2Pack, Avx2PackF);
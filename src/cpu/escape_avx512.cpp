@@ -0,0 +1,7 @@
+// compiled with -mavx512f (or /arch:AVX512), see CMakeLists.txt
+#include "cpu_renderer.h"
+#include "escape_kernel.h"
+
+// indexed by Numeric - 1
+extern const EscapeSpanFn escape_spans_avx512[4] = ESCAPE_SPAN_TABLE(Avx512Pack, Avx512PackF);
+extern const EscapeColumnFn escape_columns_avx512[4] = ESCAPE_COLUMN_TABLE(Avx512Pack, Avx512PackF);
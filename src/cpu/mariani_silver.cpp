@@ -0,0 +1,167 @@
+#include "cpu_renderer.h"
+#include "tile_scheduler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+// below this, a rectangle is cheaper to brute-force than to subdivide
+static constexpr int MIN_RECT = 16;
+// a failed border that changes band at more than 1 in BUSY_RATIO pixels is
+// computed in full instead of subdivided
+static constexpr int BUSY_RATIO = 8;
+// spans shorter than this run on the scalar kernel
+static constexpr int NARROW_SPAN = 4;
+
+namespace {
+
+// Mariani-Silver over one tile: iterate the border ring of a rectangle, fill
+// the inside if the ring is uniform, otherwise split it in two along the
+// longer side (the halves share the split line) and recurse.
+struct Subdivider {
+    const EscapeView& view;
+    CpuKernel kernel;
+    float* out;
+    int width, height;
+    const MarianiSilverOptions& options;
+    Tile tile;
+    std::vector<uint8_t> done; // per tile pixel
+    long long computed = 0, filled = 0;
+
+    uint8_t& is_done(int x, int y) { return done[(size_t)(y - tile.y0) * tile.w + (x - tile.x0)]; }
+    float at(int x, int y) const { return out[(size_t)y * width + x]; }
+    float& at(int x, int y) { return out[(size_t)y * width + x]; }
+
+    // pixels [x0, x0+w) of row y that aren't known yet, as contiguous spans
+    void compute_row(int x0, int y, int w) {
+        for (int x = x0; x < x0 + w;) {
+            if (is_done(x, y)) { x++; continue; }
+            int end = x;
+            while (end < x0 + w && !is_done(end, y)) is_done(end++, y) = 1;
+            cpu_render_rect(view, narrow(end - x), out, width, height, x, y, end - x, 1);
+            computed += end - x;
+            x = end;
+        }
+    }
+    // same for a column, one lane per row
+    void compute_column(int x, int y0, int h) {
+        for (int y = y0; y < y0 + h;) {
+            if (is_done(x, y)) { y++; continue; }
+            int end = y;
+            while (end < y0 + h && !is_done(x, end)) is_done(x, end++) = 1;
+            cpu_render_column(view, narrow(end - y), out, width, height, x, y, end - y);
+            computed += end - y;
+            y = end;
+        }
+    }
+    // a few pixels aren't worth a whole lane group
+    CpuKernel narrow(int count) const { return count < NARROW_SPAN ? CpuKernel::Scalar : kernel; }
+
+    // escape values that color the same: interior, or (integer_bands) one palette entry
+    long long band(float v) const {
+        if (v >= view.max_iterations + 1) return -1;
+        return options.integer_bands ? (long long)std::floor(v - 0.5f) : -2;
+    }
+
+    // The outer ring changes band at more than 1 in BUSY_RATIO pixels, or
+    // with smooth values, doesn't touch the interior at all.
+    bool busy(int x0, int y0, int w, int h) const {
+        int changes = 0, interior = 0;
+        long long prev = band(at(x0, y0));
+        auto step = [&](int x, int y) {
+            long long b = band(at(x, y));
+            changes += b != prev;
+            interior += b == -1;
+            prev = b;
+        };
+        for (int x = x0 + 1; x < x0 + w; x++) step(x, y0);
+        for (int y = y0 + 1; y < y0 + h; y++) step(x0 + w - 1, y);
+        for (int x = x0 + w - 2; x >= x0; x--) step(x, y0 + h - 1);
+        for (int y = y0 + h - 2; y >= y0; y--) step(x0, y);
+        if (!options.integer_bands) return interior == 0;
+        return changes * BUSY_RATIO > 2 * (w + h);
+    }
+
+    void run(int x0, int y0, int w, int h) {
+        int g = options.guard + 1; // ring thickness
+        if (w <= MIN_RECT || h <= MIN_RECT || w <= 2 * g || h <= 2 * g) {
+            for (int y = y0; y < y0 + h; y++) compute_row(x0, y, w);
+            return;
+        }
+        for (int i = 0; i < g; i++) {
+            compute_row(x0, y0 + i, w);
+            compute_row(x0, y0 + h - 1 - i, w);
+        }
+        for (int i = 0; i < g; i++) {
+            compute_column(x0 + i, y0 + g, h - 2 * g);
+            compute_column(x0 + w - 1 - i, y0 + g, h - 2 * g);
+        }
+
+        float first = at(x0, y0);
+        long long b = band(first);
+        bool uniform = b != -2;
+        for (int i = 0; i < g && uniform; i++) {
+            for (int x = x0; x < x0 + w && uniform; x++) {
+                uniform = band(at(x, y0 + i)) == b && band(at(x, y0 + h - 1 - i)) == b;
+            }
+            for (int y = y0; y < y0 + h && uniform; y++) {
+                uniform = band(at(x0 + i, y)) == b && band(at(x0 + w - 1 - i, y)) == b;
+            }
+        }
+        if (uniform) {
+            for (int y = y0 + g; y < y0 + h - g; y++) {
+                for (int x = x0 + g; x < x0 + w - g; x++) {
+                    if (is_done(x, y)) continue;
+                    at(x, y) = first;
+                    is_done(x, y) = 1;
+                    filled++;
+                }
+            }
+            return;
+        }
+        if (busy(x0, y0, w, h)) {
+            // no sub-rectangle is likely to fill either, so skip the extra
+            // borders and keep the inside in full-width spans
+            for (int y = y0 + g; y < y0 + h - g; y++) compute_row(x0 + g, y, w - 2 * g);
+            return;
+        }
+
+        if (w >= h) {
+            int mid = x0 + w / 2;
+            run(x0, y0, mid - x0 + 1, h);
+            run(mid, y0, x0 + w - mid, h);
+        } else {
+            int mid = y0 + h / 2;
+            run(x0, y0, w, mid - y0 + 1);
+            run(x0, mid, w, y0 + h - mid);
+        }
+    }
+};
+
+}
+
+void cpu_render_mariani_silver(const EscapeView& view, float* out, int width, int height, TileScheduler& scheduler,
+                               const MarianiSilverOptions& options, MarianiSilverStats* stats) {
+    CpuKernel kernel = cpu_detect_kernel();
+    std::atomic<long long> computed{0}, filled{0};
+    // every tile is a top-level rectangle, so tiles subdivide in parallel
+    scheduler.run(width, height, [&](const Tile& t) {
+        Subdivider s{view, kernel, out, width, height, options, t, std::vector<uint8_t>((size_t)t.w * t.h, 0)};
+        s.run(t.x0, t.y0, t.w, t.h);
+        computed += s.computed;
+        filled += s.filled;
+    });
+    if (stats) {
+        stats->computed = computed;
+        stats->filled = filled;
+    }
+}
+
+long long mariani_silver_mismatches(const float* a, const float* b, size_t count, bool integer_bands) {
+    long long differ = 0;
+    for (size_t i = 0; i < count; i++) {
+        differ += integer_bands ? std::floor(a[i] - 0.5f) != std::floor(b[i] - 0.5f) : a[i] != b[i];
+    }
+    return differ;
+}
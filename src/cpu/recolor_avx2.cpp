@@ -0,0 +1,57 @@
+// compiled with -mavx2 -mfma (or /arch:AVX2), see CMakeLists.txt
+#include <immintrin.h>
+#include "recolor.h"
+
+// 8 pixels per step: palette indices from the escape values, one gather per
+// channel and endpoint, and the rounding of to_rgb8. Same float ops in the
+// same order as palette_color, so the bytes match the scalar path.
+static void recolor_avx2(const RecolorPalette& p, const float* escape, int count, unsigned char* rgb) {
+    const int n = (int)p.r.size();
+    const __m256 half = _mm256_set1_ps(0.5f), scale = _mm256_set1_ps(float(p.iterations + 1));
+    const __m256 size = _mm256_set1_ps((float)n), last = _mm256_set1_ps(float(n - 1)), zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f), c255 = _mm256_set1_ps(255.0f);
+    // r0..r7 g0..g7 / b0..b7 -> r0 g0 b0 r1 g1 b1 ...
+    const __m128i lo_rg = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m128i lo_b = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i hi_rg = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i hi_b = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    auto to_bytes = [&](__m256 r, __m256 g, __m256 b, unsigned char* out) {
+        auto quantize = [&](__m256 c) { return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, c255), half)); };
+        __m256i ri = quantize(r), gi = quantize(g), bi = quantize(b);
+        // saturating packs are the clamp to 0..255
+        __m128i r16 = _mm_packs_epi32(_mm256_castsi256_si128(ri), _mm256_extracti128_si256(ri, 1));
+        __m128i g16 = _mm_packs_epi32(_mm256_castsi256_si128(gi), _mm256_extracti128_si256(gi, 1));
+        __m128i b16 = _mm_packs_epi32(_mm256_castsi256_si128(bi), _mm256_extracti128_si256(bi, 1));
+        __m128i rg = _mm_packus_epi16(r16, g16), bb = _mm_packus_epi16(b16, b16);
+        __m128i lo = _mm_or_si128(_mm_shuffle_epi8(rg, lo_rg), _mm_shuffle_epi8(bb, lo_b));
+        __m128i hi = _mm_or_si128(_mm_shuffle_epi8(rg, hi_rg), _mm_shuffle_epi8(bb, hi_b));
+        _mm_storeu_si128((__m128i*)out, lo);
+        _mm_storel_epi64((__m128i*)(out + 16), hi);
+    };
+
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(escape + k), half), scale);
+        if (!p.smooth) {
+            __m256 fl = _mm256_floor_ps(_mm256_mul_ps(t, size));
+            __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(fl, zero), last));
+            to_bytes(_mm256_i32gather_ps(p.r.data(), i, 4), _mm256_i32gather_ps(p.g.data(), i, 4),
+                     _mm256_i32gather_ps(p.b.data(), i, 4), rgb + 3 * k);
+            continue;
+        }
+        __m256 u = _mm256_sub_ps(_mm256_mul_ps(t, size), half);
+        __m256 fl = _mm256_floor_ps(u), f = _mm256_sub_ps(u, fl);
+        // clamped as floats, so huge values can't overflow the conversion
+        __m256i i0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(fl, zero), last));
+        __m256i i1 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(fl, one), zero), last));
+        auto channel = [&](const std::vector<float>& c) {
+            __m256 a = _mm256_i32gather_ps(c.data(), i0, 4), b = _mm256_i32gather_ps(c.data(), i1, 4);
+            return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), f));
+        };
+        to_bytes(channel(p.r), channel(p.g), channel(p.b), rgb + 3 * k);
+    }
+    if (k < count) cpu_recolor(CpuKernel::Scalar)(p, escape + k, count - k, rgb + 3 * k);
+}
+
+extern const RecolorFn recolor_fn_avx2 = recolor_avx2;
@@ -0,0 +1,141 @@
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+// adaptive tile size bounds, multiples of the widest SIMD pack
+static constexpr int MIN_TILE_SIZE = 16;
+static constexpr int MAX_TILE_SIZE = 256;
+// below this a tile is mostly scheduling overhead
+static constexpr double MIN_TILE_MS = 0.25;
+// enough tiles per worker for stealing to even out interior-heavy views
+static constexpr int TILES_PER_WORKER = 8;
+
+TileScheduler::TileScheduler(int num_threads) {
+    if (num_threads <= 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < num_threads; i++) queues.push_back(std::make_unique<Queue>());
+    // worker 0 is whoever calls run()
+    for (int i = 1; i < num_threads; i++) threads.emplace_back(&TileScheduler::worker_loop, this, i);
+}
+
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+}
+
+void TileScheduler::set_tile_size(int tile_size) {
+    adaptive = tile_size <= 0;
+    if (!adaptive) size = tile_size;
+}
+
+void TileScheduler::run(int width, int height, const TileFn& fn) {
+    auto start = Clock::now();
+    tiles.clear();
+    for (int y = 0; y < height; y += size) {
+        for (int x = 0; x < width; x += size) {
+            tiles.push_back({x, y, std::min(size, width - x), std::min(size, height - y)});
+        }
+    }
+    stats.assign(tiles.size(), TileStats{});
+
+    // deal tiles round-robin, so each worker starts with a slice of every row band
+    int n = num_threads();
+    for (int i = 0; i < (int)tiles.size(); i++) queues[i % n]->tiles.push_back(i);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        active_workers = n;
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        active_workers--;
+        finished.wait(lock, [this] { return active_workers == 0; });
+        job = nullptr;
+    }
+
+    run_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (adaptive) adapt();
+}
+
+void TileScheduler::worker_loop(int worker) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+        drain(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active_workers == 0) finished.notify_all();
+        }
+    }
+}
+
+void TileScheduler::drain(int worker) {
+    int tile;
+    while (pop(worker, tile) || steal(worker, tile)) {
+        auto start = Clock::now();
+        (*job)(tiles[tile]);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        stats[tile] = {tiles[tile], ms, worker};
+    }
+}
+
+bool TileScheduler::pop(int worker, int& tile) {
+    Queue& q = *queues[worker];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tiles.empty()) return false;
+    tile = q.tiles.back();
+    q.tiles.pop_back();
+    return true;
+}
+
+bool TileScheduler::steal(int worker, int& tile) {
+    int n = num_threads();
+    for (int i = 1; i < n; i++) {
+        Queue& q = *queues[(worker + i) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tiles.empty()) continue;
+        tile = q.tiles.front();
+        q.tiles.pop_front();
+        return true;
+    }
+    return false;
+}
+
+// Picks the next tile size from this run's costs: shrink while the most
+// expensive tile is a large share of a worker's fair slice (or there are too
+// few tiles to steal), grow while the average tile is cheaper than the
+// scheduling overhead. Halving the size quarters the mean tile cost, so only
+// shrink if that still stays above MIN_TILE_MS; otherwise the two rules fight.
+void TileScheduler::adapt() {
+    if (stats.empty()) return;
+    double total = 0.0, worst = 0.0;
+    for (const TileStats& s : stats) {
+        total += s.ms;
+        worst = std::max(worst, s.ms);
+    }
+    double mean = total / stats.size();
+    double fair_share = total / num_threads();
+
+    bool too_few = (int)stats.size() < num_threads() * TILES_PER_WORKER;
+    if ((worst > fair_share / 4 || too_few) && mean / 4 >= MIN_TILE_MS && size > MIN_TILE_SIZE) {
+        size /= 2;
+    } else if (mean < MIN_TILE_MS && !too_few && size < MAX_TILE_SIZE) {
+        size *= 2;
+    }
+}
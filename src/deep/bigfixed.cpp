@@ -0,0 +1,193 @@
+#include "bigfixed.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+BigFixed::BigFixed(double value, int frac_limbs) : limbs(frac_limbs + 1, 0) {
+    double mag = std::fabs(value);
+    double whole = std::floor(mag);
+    limbs.back() = (uint32_t)whole;
+    double frac = mag - whole;
+    // exact: scaling by 2^32 and peeling off the integer part loses no bits
+    for (int i = frac_limbs - 1; i >= 0 && frac != 0.0; i--) {
+        frac = std::ldexp(frac, 32);
+        double digit = std::floor(frac);
+        limbs[i] = (uint32_t)digit;
+        frac -= digit;
+    }
+    if (value < 0) *this = -*this;
+}
+
+BigFixed::BigFixed(const FloatExp& value, int frac_limbs) : limbs(frac_limbs + 1, 0) {
+    if (value.m == 0.0) return;
+    // 53-bit integer mantissa, its lowest bit sits `shift` bits above the
+    // lowest fraction bit
+    uint64_t mant = (uint64_t)std::ldexp(std::fabs(value.m), 53);
+    long long shift = (long long)value.e - 53 + 32LL * frac_limbs;
+    if (shift < 0) {
+        if (shift <= -64) return;
+        mant >>= -shift;
+        shift = 0;
+    }
+    for (int bit = 0; bit < 64 && mant >> bit; bit += 32) {
+        long long pos = shift + bit;
+        uint64_t chunk = (mant >> bit) & 0xFFFFFFFFull;
+        long long l = pos / 32;
+        int off = (int)(pos % 32);
+        if (l < (long long)limbs.size()) limbs[l] |= (uint32_t)(chunk << off);
+        if (off && l + 1 < (long long)limbs.size()) limbs[l + 1] |= (uint32_t)(chunk >> (32 - off));
+    }
+    if (value.m < 0) *this = -*this;
+}
+
+bool BigFixed::parse(const std::string& str, int frac_limbs, BigFixed& out) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < str.size() && (str[i] == '-' || str[i] == '+')) negative = str[i++] == '-';
+
+    uint64_t whole = 0;
+    size_t digits = 0;
+    for (; i < str.size() && std::isdigit((unsigned char)str[i]); i++, digits++) {
+        whole = whole * 10 + (str[i] - '0');
+        // the integer part is a signed 32-bit limb
+        if (whole > INT32_MAX) return false;
+    }
+    size_t frac_begin = i, frac_end = i;
+    if (i < str.size() && str[i] == '.') {
+        frac_begin = frac_end = ++i;
+        for (; i < str.size() && std::isdigit((unsigned char)str[i]); i++, digits++) frac_end = i + 1;
+    }
+    if (i != str.size() || digits == 0) return false;
+
+    BigFixed result(0.0, frac_limbs);
+    // value = (d + value) / 10, from the last fraction digit to the first
+    for (size_t k = frac_end; k-- > frac_begin;) {
+        uint64_t rem = str[k] - '0';
+        for (int l = frac_limbs - 1; l >= 0; l--) {
+            uint64_t cur = (rem << 32) | result.limbs[l];
+            result.limbs[l] = (uint32_t)(cur / 10);
+            rem = cur % 10;
+        }
+    }
+    result.limbs.back() = (uint32_t)whole;
+    out = negative ? -result : result;
+    return true;
+}
+
+std::string BigFixed::to_string(int digits) const {
+    BigFixed mag = abs();
+    std::string str = is_negative() ? "-" : "";
+    str += std::to_string(mag.limbs.back());
+    str += '.';
+    if (digits < 0) digits = (int)std::ceil(frac_limbs() * 32 * std::log10(2.0));
+    // peel decimal digits off the fraction by multiplying it by 10
+    for (int d = 0; d < digits; d++) {
+        uint64_t carry = 0;
+        for (int l = 0; l < mag.frac_limbs(); l++) {
+            uint64_t cur = (uint64_t)mag.limbs[l] * 10 + carry;
+            mag.limbs[l] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        str += char('0' + carry);
+    }
+    return str;
+}
+
+double BigFixed::to_double() const {
+    BigFixed mag = abs();
+    double result = 0.0;
+    int n = mag.frac_limbs();
+    // only the top ~3 nonzero limbs matter for a double
+    int significant = 0;
+    for (int l = n; l >= 0 && significant < 3; l--) {
+        if (mag.limbs[l] == 0 && significant == 0) continue;
+        result += std::ldexp((double)mag.limbs[l], 32 * (l - n));
+        significant++;
+    }
+    return is_negative() ? -result : result;
+}
+
+FloatExp BigFixed::to_floatexp() const {
+    BigFixed mag = abs();
+    int n = mag.frac_limbs();
+    int top = n;
+    while (top >= 0 && mag.limbs[top] == 0) top--;
+    if (top < 0) return FloatExp();
+    // top three limbs relative to the leading one, exponent kept separately
+    double m = 0.0;
+    for (int l = top; l >= 0 && l > top - 3; l--) m += std::ldexp((double)mag.limbs[l], 32 * (l - top));
+    FloatExp result(m, 32 * (top - n));
+    return is_negative() ? -result : result;
+}
+
+void BigFixed::to_expansion(double* parts, int n) const {
+    BigFixed rest = *this;
+    for (int i = 0; i < n; i++) {
+        parts[i] = rest.to_double();
+        // a double converts back exactly, so the remainder is exact too
+        rest = rest - BigFixed(parts[i], rest.frac_limbs());
+    }
+}
+
+void BigFixed::set_frac_limbs(int n) {
+    int diff = n - frac_limbs();
+    if (diff > 0) limbs.insert(limbs.begin(), diff, 0);
+    else if (diff < 0) limbs.erase(limbs.begin(), limbs.begin() - diff);
+}
+
+BigFixed BigFixed::operator-() const {
+    BigFixed result = *this;
+    uint64_t carry = 1;
+    for (uint32_t& limb : result.limbs) {
+        uint64_t cur = (uint64_t)(~limb) + carry;
+        limb = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+    return result;
+}
+
+BigFixed BigFixed::operator+(const BigFixed& other) const {
+    int n = std::max(frac_limbs(), other.frac_limbs());
+    BigFixed a = *this, b = other;
+    a.set_frac_limbs(n);
+    b.set_frac_limbs(n);
+    uint64_t carry = 0;
+    for (size_t l = 0; l < a.limbs.size(); l++) {
+        uint64_t cur = (uint64_t)a.limbs[l] + b.limbs[l] + carry;
+        a.limbs[l] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+    return a;
+}
+
+BigFixed BigFixed::operator-(const BigFixed& other) const { return *this + -other; }
+
+BigFixed BigFixed::operator*(const BigFixed& other) const {
+    BigFixed a = abs(), b = other.abs();
+    int fa = a.frac_limbs(), fb = b.frac_limbs();
+    int n = std::max(fa, fb);
+
+    // schoolbook product, then drop the extra fraction limbs (truncating)
+    std::vector<uint32_t> product(a.limbs.size() + b.limbs.size(), 0);
+    for (size_t i = 0; i < a.limbs.size(); i++) {
+        if (a.limbs[i] == 0) continue;
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.limbs.size(); j++) {
+            uint64_t cur = (uint64_t)a.limbs[i] * b.limbs[j] + product[i + j] + carry;
+            product[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        product[i + b.limbs.size()] = (uint32_t)carry;
+    }
+
+    BigFixed result;
+    int drop = fa + fb - n;
+    result.limbs.assign(product.begin() + drop, product.begin() + drop + n + 1);
+    return is_negative() != other.is_negative() ? -result : result;
+}
+
+int frac_limbs_for_zoom(const FloatExp& zoom) {
+    double bits = std::max(0.0, zoom.log2()) + 64.0;
+    return (int)std::ceil(bits / 32.0) + 1;
+}
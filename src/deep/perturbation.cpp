@@ -0,0 +1,140 @@
+#include "perturbation.h"
+#include "escape_kernel.h"
+#include "tile_scheduler.h"
+
+#include <cmath>
+
+// the reference gets recomputed once the zoom outgrows its precision headroom
+static constexpr double REFERENCE_ZOOM_RANGE = 65536.0;
+
+void compute_reference_orbit(ReferenceOrbit& ref, const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom, int iterations) {
+    int limbs = frac_limbs_for_zoom(zoom);
+    ref.center_x = cx;
+    ref.center_y = cy;
+    ref.center_x.set_frac_limbs(limbs);
+    ref.center_y.set_frac_limbs(limbs);
+    ref.zoom = zoom;
+    ref.iterations = iterations;
+    ref.z.assign({0.0, 0.0});
+
+    BigFixed zx(0.0, limbs), zy(0.0, limbs);
+    for (int i = 1; i <= iterations; i++) {
+        BigFixed x2 = zx * zx, y2 = zy * zy, xy = zx * zy;
+        zx = x2 - y2 + ref.center_x;
+        zy = xy + xy + ref.center_y;
+        double re = zx.to_double(), im = zy.to_double();
+        ref.z.push_back(re);
+        ref.z.push_back(im);
+        // an escaped reference is still usable, pixels rebase when it ends
+        if (re * re + im * im > 4.0) break;
+    }
+}
+
+bool reference_is_stale(const ReferenceOrbit& ref, const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom, int iterations) {
+    if (ref.z.empty() || ref.iterations != iterations) return true;
+    if (zoom > ref.zoom * REFERENCE_ZOOM_RANGE) return true;
+    // off-screen references still work, they just rebase a lot
+    double off_x = ((cx - ref.center_x).to_floatexp() * zoom).to_double();
+    double off_y = ((cy - ref.center_y).to_floatexp() * zoom).to_double();
+    return off_x * off_x + off_y * off_y > 4.0;
+}
+
+float perturbed_escape(const ReferenceOrbit& ref, double dc_x, double dc_y, int iterations) {
+    const double* Z = ref.z.data();
+    int n = ref.length();
+    double dz_x = 0.0, dz_y = 0.0;
+    int m = 0;
+    for (int i = 1; i <= iterations; i++) {
+        if (m == n - 1) { // reference exhausted
+            dz_x += Z[2 * m];
+            dz_y += Z[2 * m + 1];
+            m = 0;
+        }
+        double zr = Z[2 * m], zi = Z[2 * m + 1];
+        double nx = 2.0 * (zr * dz_x - zi * dz_y) + (dz_x * dz_x - dz_y * dz_y) + dc_x;
+        double ny = 2.0 * (zr * dz_y + zi * dz_x) + 2.0 * dz_x * dz_y + dc_y;
+        dz_x = nx;
+        dz_y = ny;
+        m++;
+
+        double x = Z[2 * m] + dz_x, y = Z[2 * m + 1] + dz_y;
+        double mag_sq = x * x + y * y;
+        if (mag_sq > ESCAPE_RADIUS_SQ) return smooth_escape(i, mag_sq, iterations);
+        if (mag_sq < dz_x * dz_x + dz_y * dz_y) { // glitch: rebase
+            dz_x = x;
+            dz_y = y;
+            m = 0;
+        }
+    }
+    return float(iterations + 1);
+}
+
+// Same loop as perturbed_escape(). Only dz and dc need the extra range, the
+// reference and the full z = Z + dz are O(1) and stay in doubles.
+float perturbed_escape_fe(const ReferenceOrbit& ref, const FloatExp& dc_x, const FloatExp& dc_y, int iterations) {
+    const double* Z = ref.z.data();
+    int n = ref.length();
+    FloatExp dz_x, dz_y;
+    int m = 0;
+    for (int i = 1; i <= iterations; i++) {
+        if (m == n - 1) {
+            dz_x = FloatExp(Z[2 * m] + dz_x.to_double());
+            dz_y = FloatExp(Z[2 * m + 1] + dz_y.to_double());
+            m = 0;
+        }
+        FloatExp zr2 = 2.0 * Z[2 * m], zi2 = 2.0 * Z[2 * m + 1];
+        FloatExp xy = dz_x * dz_y;
+        FloatExp nx = zr2 * dz_x - zi2 * dz_y + (dz_x * dz_x - dz_y * dz_y) + dc_x;
+        FloatExp ny = zr2 * dz_y + zi2 * dz_x + (xy + xy) + dc_y;
+        dz_x = nx;
+        dz_y = ny;
+        m++;
+
+        double dx = dz_x.to_double(), dy = dz_y.to_double(); // 0 while dz is tiny
+        double x = Z[2 * m] + dx, y = Z[2 * m + 1] + dy;
+        double mag_sq = x * x + y * y;
+        if (mag_sq > ESCAPE_RADIUS_SQ) return smooth_escape(i, mag_sq, iterations);
+        if (mag_sq < dx * dx + dy * dy) {
+            dz_x = FloatExp(x);
+            dz_y = FloatExp(y);
+            m = 0;
+        }
+    }
+    return float(iterations + 1);
+}
+
+void cpu_render_perturbed(const ReferenceOrbit& ref, const DeepView& view, float* out, int width, int height,
+                          int x0, int y0, int w, int h) {
+    int image_width = view.image_width ? view.image_width : width;
+    int image_height = view.image_height ? view.image_height : height;
+    FloatExp scale_x = FloatExp(view.aspect) / view.zoom;
+    FloatExp scale_y = FloatExp(1.0) / view.zoom;
+    bool extended = view.zoom > FLOATEXP_ZOOM_THRESHOLD;
+    for (int y = y0; y < y0 + h; y++) {
+        FloatExp dc_y = view.offset_y + ((2.0 * (view.origin_y + y + view.jitter_y) + 1.0) / image_height - 1.0) * scale_y;
+        for (int x = x0; x < x0 + w; x++) {
+            FloatExp dc_x = view.offset_x + ((2.0 * (view.origin_x + x + view.jitter_x) + 1.0) / image_width - 1.0) * scale_x;
+            out[(size_t)y * width + x] = extended
+                ? perturbed_escape_fe(ref, dc_x, dc_y, view.max_iterations)
+                : perturbed_escape(ref, dc_x.to_double(), dc_y.to_double(), view.max_iterations);
+        }
+    }
+}
+
+void cpu_render_perturbed(const ReferenceOrbit& ref, const DeepView& view, float* out, int width, int height,
+                          TileScheduler& scheduler) {
+    scheduler.run(width, height, [&](const Tile& t) {
+        cpu_render_perturbed(ref, view, out, width, height, t.x0, t.y0, t.w, t.h);
+    });
+}
+
+OrbitBuffer::OrbitBuffer() { glGenBuffers(1, &id); }
+OrbitBuffer::~OrbitBuffer() { glDeleteBuffers(1, &id); }
+
+void OrbitBuffer::upload(const ReferenceOrbit& ref) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ref.z.size() * sizeof(double), ref.z.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void OrbitBuffer::bind(GLuint binding) { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, id); }
@@ -0,0 +1,164 @@
+#include "escape_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char MAGIC[8] = {'M', 'A', 'N', 'D', 'E', 'S', 'C', '\0'};
+static constexpr uint32_t VERSION = 1;
+static constexpr uint64_t PAGE = 4096;
+
+static uint64_t page_align(uint64_t n) { return (n + PAGE - 1) / PAGE * PAGE; }
+
+// a gigapixel is 4 GB of floats
+static int seek(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(f, (long long)offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static uint64_t tiles_across(const EscapeFileHeader& h) { return (h.width + h.tile - 1) / h.tile; }
+static uint64_t tiles_down(const EscapeFileHeader& h) { return (h.height + h.tile - 1) / h.tile; }
+
+EscapeFileWriter::~EscapeFileWriter() {
+    if (file) std::fclose(file);
+}
+
+bool EscapeFileWriter::open(const std::string& path, int width, int height, int tile, int iterations,
+                            const nlohmann::json& params) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    std::string text = params.dump();
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = VERSION;
+    header.width = width;
+    header.height = height;
+    header.tile = tile;
+    header.iterations = iterations;
+    header.params_size = text.size();
+    header.data_offset = page_align(sizeof header + text.size());
+    header.tile_stride = page_align((uint64_t)tile * tile * sizeof(float));
+    bool ok = std::fwrite(&header, sizeof header, 1, file) == 1 && std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (!ok) std::cerr << "Failed to write " << path << std::endl;
+    return ok;
+}
+
+bool EscapeFileWriter::write_tile(int tx, int ty, int w, int h, const float* escape) {
+    // flipped to top row first, padded out to a full tile
+    std::vector<float> block((size_t)header.tile * header.tile, 0.0f);
+    for (int y = 0; y < h; y++) std::copy_n(escape + (size_t)(h - 1 - y) * w, w, block.data() + (size_t)y * header.tile);
+    uint64_t offset = header.data_offset + ((uint64_t)ty * tiles_across(header) + tx) * header.tile_stride;
+    bool ok = seek(file, offset) == 0 && std::fwrite(block.data(), sizeof(float), block.size(), file) == block.size();
+    if (!ok) std::cerr << "Failed to write escape tile " << tx << ", " << ty << std::endl;
+    return ok;
+}
+
+bool EscapeFileWriter::close() {
+    if (!file) return false;
+    // the last tile's page padding, so the file maps in full
+    uint64_t end = header.data_offset + tiles_across(header) * tiles_down(header) * header.tile_stride;
+    bool ok = seek(file, end - 1) == 0 && std::fputc(0, file) != EOF;
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok) std::cerr << "Failed to finish escape file" << std::endl;
+    return ok;
+}
+
+EscapeFile::~EscapeFile() { close(); }
+
+bool EscapeFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size{};
+    if (f == INVALID_HANDLE_VALUE || !GetFileSizeEx(f, &size)) {
+        std::cerr << "Failed to open " << path << std::endl;
+        if (f != INVALID_HANDLE_VALUE) CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        std::cerr << "Failed to map " << path << std::endl;
+        if (m) CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    mapped_bytes = (size_t)size.QuadPart;
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cerr << "Failed to open " << path << std::endl;
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    mapped_bytes = (size_t)st.st_size;
+#endif
+    base = (const unsigned char*)view;
+
+    bool ok = mapped_bytes >= sizeof header;
+    if (ok) {
+        std::memcpy(&header, base, sizeof header);
+        ok = std::memcmp(header.magic, MAGIC, sizeof MAGIC) == 0 && header.version == VERSION && header.tile > 0 &&
+             header.data_offset >= sizeof header + header.params_size &&
+             header.tile_stride >= (uint64_t)header.tile * header.tile * sizeof(float) &&
+             header.data_offset + tiles_across(header) * tiles_down(header) * header.tile_stride <= mapped_bytes;
+    }
+    if (ok) {
+        const char* text = (const char*)base + sizeof header;
+        params_json = nlohmann::json::parse(text, text + header.params_size, nullptr, false);
+        ok = !params_json.is_discarded();
+    }
+    if (!ok) {
+        std::cerr << path << " is not a complete escape file" << std::endl;
+        close();
+    }
+    return ok;
+}
+
+void EscapeFile::close() {
+    if (!base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    file = mapping = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(base), mapped_bytes);
+    ::close(fd);
+    fd = -1;
+#endif
+    base = nullptr;
+    mapped_bytes = 0;
+}
+
+const float* EscapeFile::tile_data(int tx, int ty) const {
+    return (const float*)(base + header.data_offset + ((uint64_t)ty * tiles_across(header) + tx) * header.tile_stride);
+}
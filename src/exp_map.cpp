@@ -0,0 +1,126 @@
+#include "exp_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "adaptive_aa.h"
+#include "batch.h"
+#include "tile_scheduler.h"
+
+constexpr double TWO_PI = 6.283185307179586;
+constexpr double LN2 = 0.6931471805599453;
+constexpr float INSIDE = std::numeric_limits<float>::infinity();
+
+// log2 of the pixel size at `zoom` (the half-height is 1/zoom)
+static double log2_pixel(double log2_zoom, int height) { return 1.0 - log2_zoom - std::log2((double)height); }
+
+void ExpMap::build(const BigFixed& cx, const BigFixed& cy, const FloatExp& zoom_min, const FloatExp& zoom_max, int w,
+                   int h, const IterationsFn& iterations, TileScheduler& scheduler) {
+    width = w;
+    height = h;
+    double half_diagonal = 0.5 * std::sqrt((double)w * w + (double)h * h);
+    // one sample per pixel around the frame's corners, more further in
+    columns = std::max(8, (int)std::ceil(TWO_PI * half_diagonal / 8.0) * 8);
+    step = TWO_PI / columns;
+    double l_min = zoom_min.log2(), l_max = zoom_max.log2();
+    // a row of margin outside the widest frame's corners
+    log2_outer = std::log2(half_diagonal) + log2_pixel(l_min, h) + step / LN2;
+    // the middle is a square as big as the frame is tall (or wide) at the deepest zoom
+    patch_size = std::min(w, h);
+    log2_patch_pixel = log2_pixel(l_max, h);
+    double log2_inner = std::log2(0.5 * patch_size) + log2_patch_pixel;
+    // and the strip reaches a couple of rows into it, for the filtering
+    rows = std::max(2, (int)std::ceil((log2_outer - log2_inner) * LN2 / step) + 2);
+
+    // A row is on screen from when it's at the corners until it's a pixel from
+    // the center, and has to escape the same as in all of those frames.
+    std::vector<int> row_iterations(rows);
+    int most = iterations(zoom_max);
+    for (int j = 0; j < rows; j++) {
+        double log2_r = log2_outer - j * step / LN2;
+        double deepest = 1.0 - std::log2((double)h) - log2_r; // zoom where r is a pixel
+        row_iterations[j] = iterations(FloatExp::from_log2(std::clamp(deepest, l_min, l_max)));
+        most = std::max(most, row_iterations[j]);
+    }
+    compute_reference_orbit(reference, cx, cy, zoom_max, most);
+
+    strip.assign((size_t)rows * columns, 0.0f);
+    FloatExp tiny = FloatExp(1.0) / FloatExp(FLOATEXP_ZOOM_THRESHOLD);
+    scheduler.run(columns, rows, [&](const Tile& t) {
+        for (int j = t.y0; j < t.y0 + t.h; j++) {
+            FloatExp r = FloatExp::from_log2(log2_outer - j * step / LN2);
+            bool extended = r < tiny;
+            int it = row_iterations[j];
+            for (int i = t.x0; i < t.x0 + t.w; i++) {
+                double angle = i * step;
+                FloatExp dc_x = r * std::cos(angle), dc_y = r * std::sin(angle);
+                float v = extended ? perturbed_escape_fe(reference, dc_x, dc_y, it)
+                                   : perturbed_escape(reference, dc_x.to_double(), dc_y.to_double(), it);
+                // inside stays inside for frames with fewer iterations than the row
+                strip[(size_t)j * columns + i] = v >= float(it + 1) ? INSIDE : v;
+            }
+        }
+    });
+
+    DeepView view;
+    view.zoom = FloatExp(2.0 / patch_size) / FloatExp::from_log2(log2_patch_pixel);
+    view.aspect = 1.0;
+    view.max_iterations = iterations(zoom_max);
+    patch.assign((size_t)patch_size * patch_size, 0.0f);
+    cpu_render_perturbed(reference, view, patch.data(), patch_size, patch_size, scheduler);
+    for (float& v : patch) {
+        if (v >= float(view.max_iterations + 1)) v = INSIDE;
+    }
+}
+
+void ExpMap::resample(const FloatExp& zoom, int iterations, const std::vector<glm::vec3>& colors, bool smooth, int samples,
+                      glm::vec3* rgb, TileScheduler& scheduler) const {
+    double log2_p = log2_pixel(zoom.log2(), height);
+    // row of a point rho pixels out: base - ln(rho) / step
+    double base = (log2_outer - log2_p) * LN2 / step;
+    // frame pixels per middle-render pixel, and how far out the middle reaches
+    double scale = std::exp2(log2_p - log2_patch_pixel);
+    double patch_radius = (0.5 * patch_size - 1.0) / scale;
+    float limit = float(iterations + 1);
+    auto color = [&](float v) { return palette_color(std::min(v, limit), iterations, colors, smooth); };
+    auto mix = [](const glm::vec3& a, const glm::vec3& b, float f) {
+        return glm::vec3(a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f, a.z + (b.z - a.z) * f);
+    };
+
+    // bilinear between the colors of the 4 nearest points
+    auto point = [&](double px, double py) {
+        double rho = std::sqrt(px * px + py * py);
+        if (rho < patch_radius) {
+            double qx = px * scale + 0.5 * patch_size - 0.5, qy = py * scale + 0.5 * patch_size - 0.5;
+            int x0 = std::clamp((int)std::floor(qx), 0, patch_size - 2), y0 = std::clamp((int)std::floor(qy), 0, patch_size - 2);
+            float fx = (float)std::clamp(qx - x0, 0.0, 1.0), fy = (float)std::clamp(qy - y0, 0.0, 1.0);
+            const float* p = patch.data() + (size_t)y0 * patch_size + x0;
+            return mix(mix(color(p[0]), color(p[1]), fx), mix(color(p[patch_size]), color(p[patch_size + 1]), fx), fy);
+        }
+        double u = std::clamp(base - std::log(rho) / step, 0.0, rows - 1.001);
+        double angle = std::atan2(py, px);
+        if (angle < 0.0) angle += TWO_PI;
+        double c = angle / step;
+        int j = (int)u, i0 = (int)c % columns, i1 = (i0 + 1) % columns;
+        float fu = (float)(u - j), fc = (float)(c - std::floor(c));
+        const float* r0 = strip.data() + (size_t)j * columns;
+        const float* r1 = r0 + columns;
+        return mix(mix(color(r0[i0]), color(r0[i1]), fc), mix(color(r1[i0]), color(r1[i1]), fc), fu);
+    };
+
+    scheduler.run(width, height, [&](const Tile& t) {
+        for (int y = t.y0; y < t.y0 + t.h; y++) {
+            for (int x = t.x0; x < t.x0 + t.w; x++) {
+                glm::vec3 sum(0.0f, 0.0f, 0.0f);
+                for (int k = 0; k < samples; k++) {
+                    double dx, dy;
+                    AdaptiveAA::sample_offset(k, dx, dy);
+                    glm::vec3 c = point(x + 0.5 + dx - 0.5 * width, y + 0.5 + dy - 0.5 * height);
+                    sum = glm::vec3(sum.x + c.x, sum.y + c.y, sum.z + c.z);
+                }
+                rgb[(size_t)y * width + x] = glm::vec3(sum.x / samples, sum.y / samples, sum.z / samples);
+            }
+        }
+    });
+}
@@ -0,0 +1,115 @@
+#include "export_journal.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+
+static unsigned long tile_crc(const float* escape, const unsigned char* rgb, size_t pixels) {
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(escape), (uInt)(pixels * sizeof(float)));
+    return crc32(crc, rgb, (uInt)(pixels * 3));
+}
+
+// the .tiles file passes 2 GB at a few hundred megapixels
+static int seek(FILE* f, long long offset) {
+#ifdef _WIN32
+    return _fseeki64(f, offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+ExportJournal::~ExportJournal() { close(); }
+
+void ExportJournal::close() {
+    if (journal) std::fclose(journal);
+    if (data) std::fclose(data);
+    journal = data = nullptr;
+}
+
+bool ExportJournal::open(const std::string& output, const std::string& params) {
+    journal_path = output + ".journal";
+    data_path = output + ".tiles";
+    entries.clear();
+    std::error_code ec;
+
+    // keep the lines of a journal for the same parameters, up to the first torn one
+    long long journal_end = 0;
+    bool resume = false;
+    std::ifstream in(journal_path, std::ios::binary);
+    std::string line;
+    if (in && std::getline(in, line) && !in.eof() && line == "params " + params) {
+        resume = true;
+        journal_end = (long long)line.size() + 1;
+        long long data_end = std::filesystem::file_size(data_path, ec);
+        if (ec) data_end = 0;
+        while (std::getline(in, line) && !in.eof()) {
+            std::istringstream fields(line);
+            std::string tag;
+            int x0, y0;
+            Entry e;
+            if (!(fields >> tag >> x0 >> y0 >> e.w >> e.h >> e.offset >> e.crc) || tag != "tile" ||
+                e.offset + (long long)e.w * e.h * 7 > data_end) {
+                break;
+            }
+            entries[{x0, y0}] = e;
+            journal_end += (long long)line.size() + 1;
+        }
+    }
+    in.close();
+
+    if (resume) {
+        std::filesystem::resize_file(journal_path, journal_end, ec);
+        journal = std::fopen(journal_path.c_str(), "ab");
+        data = std::fopen(data_path.c_str(), "a+b");
+    } else {
+        journal = std::fopen(journal_path.c_str(), "wb");
+        data = std::fopen(data_path.c_str(), "w+b");
+        if (journal) std::fprintf(journal, "params %s\n", params.c_str());
+    }
+    if (!journal || !data) {
+        std::cerr << "Failed to open checkpoint files for " << output << std::endl;
+        close();
+        return false;
+    }
+    data_size = std::filesystem::file_size(data_path, ec);
+    std::fflush(journal);
+    return true;
+}
+
+bool ExportJournal::load(int x0, int y0, int w, int h, float* escape, unsigned char* rgb) {
+    auto it = entries.find({x0, y0});
+    if (!data || it == entries.end() || it->second.w != w || it->second.h != h) return false;
+    size_t pixels = (size_t)w * h;
+    bool ok = seek(data, it->second.offset) == 0 &&
+              std::fread(escape, sizeof(float), pixels, data) == pixels &&
+              std::fread(rgb, 3, pixels, data) == pixels &&
+              tile_crc(escape, rgb, pixels) == it->second.crc;
+    if (!ok) entries.erase(it);
+    return ok;
+}
+
+bool ExportJournal::append(int x0, int y0, int w, int h, const float* escape, const unsigned char* rgb) {
+    if (!data || !journal) return false;
+    size_t pixels = (size_t)w * h;
+    // "a+" mode appends whatever the last read's position was
+    long long offset = data_size;
+    bool ok = std::fwrite(escape, sizeof(float), pixels, data) == pixels && std::fwrite(rgb, 3, pixels, data) == pixels &&
+              std::fflush(data) == 0;
+    if (!ok) {
+        std::cerr << "Failed to write checkpoint data to " << data_path << std::endl;
+        return false;
+    }
+    data_size += (long long)pixels * 7;
+    std::fprintf(journal, "tile %d %d %d %d %lld %lu\n", x0, y0, w, h, offset, tile_crc(escape, rgb, pixels));
+    return std::fflush(journal) == 0;
+}
+
+void ExportJournal::finish() {
+    close();
+    std::error_code ec;
+    std::filesystem::remove(journal_path, ec);
+    std::filesystem::remove(data_path, ec);
+}
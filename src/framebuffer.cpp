@@ -14,6 +14,11 @@ FrameBuffer::FrameBuffer(int width, int height, Format format, bool with_depth_s
             m_format_enum = GL_RED;
             m_type = GL_FLOAT;
             break;
+        case Format::RGBA32F:
+            m_format = GL_RGBA32F;
+            m_format_enum = GL_RGBA;
+            m_type = GL_FLOAT;
+            break;
         default:
             throw std::runtime_error("Unknown framebuffer format");
     }
@@ -43,6 +48,10 @@ FrameBuffer::FrameBuffer(int width, int height, Format format, bool with_depth_s
 }
 
 void FrameBuffer::resize(int new_width, int new_height) {
+    // reallocating would throw away the contents (and costs a bit every frame)
+    if (new_width == width && new_height == height) return;
+    width = new_width;
+    height = new_height;
     bind();
     bind_texture();
     glTexImage2D(GL_TEXTURE_2D, 0, m_format, new_width, new_height, 0, m_format_enum, m_type, NULL);
@@ -62,6 +71,20 @@ void FrameBuffer::resize(int new_width, int new_height) {
     unbind();
 }
 
+// replaces the whole texture with client-side pixels (e.g. from the cpu renderer)
+void FrameBuffer::upload(const void* pixels) {
+    bind_texture();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, m_format_enum, m_type, pixels);
+    unbind_texture();
+}
+
+// reads the whole texture back, e.g. to diff two renders
+void FrameBuffer::download(void* pixels) {
+    bind_texture();
+    glGetTexImage(GL_TEXTURE_2D, 0, m_format_enum, m_type, pixels);
+    unbind_texture();
+}
+
 void FrameBuffer::bind() { glBindFramebuffer(GL_FRAMEBUFFER, id); }
 void FrameBuffer::unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
 void FrameBuffer::bind_texture() { glBindTexture(GL_TEXTURE_2D, texture_id); };
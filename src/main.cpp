@@ -5,21 +5,41 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include "implot.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
 
 #include <iostream>
 #include <thread>
 #include <filesystem>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <memory>
 
 #include "shader.h"
 #include "framebuffer.h"
 #include "palette.h"
 #include "settings.h"
+#include "cpu_renderer.h"
+#include "tile_scheduler.h"
+#include "perturbation.h"
+#include "compute_pass.h"
+#include "mariani_silver_pass.h"
+#include "adaptive_aa.h"
+#include "time_slicer.h"
+#include "batch.h"
+#include "png_stream.h"
+#include "animation.h"
+#include "recolor.h"
+#include "tile_cache.h"
+#include "render_graph.h"
 
 #include "shaders/vertex.vert"
 #include "shaders/fractal_pass.frag"
+#include "shaders/fractal_float_pass.frag"
+#include "shaders/fractal_ff_pass.frag"
+#include "shaders/perturbation_pass.frag"
+#include "shaders/perturbation_floatexp_pass.frag"
+#include "shaders/reproject_pass.frag"
 #include "shaders/palette_pass.frag"
 #include "shaders/downsample_pass.frag"
 
@@ -29,6 +49,33 @@
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
+// The render graph's inputs that are compared frame to frame. The camera
+// isn't among them, every change to it goes through mark_dirty().
+struct FrameInputs {
+    int iterations, width, height;
+    PaletteChannels palette;
+    bool smooth;
+    bool antialias, accumulate;
+    int aa_samples, accumulate_samples;
+    float aa_threshold;
+
+    explicit FrameInputs(const AppState& s)
+        : iterations(s.max_iterations), width(s.width), height(s.height), palette(s.palette_state),
+          smooth(s.palette_state.use_smooth), antialias(s.antialias), accumulate(s.accumulate),
+          aa_samples(s.aa_samples), accumulate_samples(s.accumulate_samples), aa_threshold(s.aa_threshold) {}
+
+    // RenderInput bits that differ from `last`
+    unsigned changed(const FrameInputs& last) const {
+        unsigned bits = 0;
+        if (iterations != last.iterations) bits |= INPUT_ITERATIONS;
+        if (width != last.width || height != last.height) bits |= INPUT_WINDOW;
+        if (palette != last.palette || smooth != last.smooth) bits |= INPUT_PALETTE;
+        if (antialias != last.antialias || accumulate != last.accumulate || aa_samples != last.aa_samples ||
+            accumulate_samples != last.accumulate_samples || aa_threshold != last.aa_threshold) bits |= INPUT_QUALITY;
+        return bits;
+    }
+};
+
 
 #ifdef _WIN32
 #include <windows.h>
@@ -57,9 +104,55 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 // }
 
 int main(int argc, char** argv) {
+    const char* batch_file = nullptr;
+    const char* animation_file = nullptr;
+    const char* recolor_input = nullptr;
+    const char* recolor_output = nullptr;
+    const char* palette_file = nullptr;
+    int batch_workers = 0;
+    bool check_ms = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench") {
+            cpu_print_benchmark();
+            return 0;
+        } else if (std::string(argv[i]) == "--batch" && i + 1 < argc) {
+            batch_file = argv[++i];
+        } else if (std::string(argv[i]) == "--animate" && i + 1 < argc) {
+            animation_file = argv[++i];
+        } else if (std::string(argv[i]) == "--recolor" && i + 2 < argc) {
+            recolor_input = argv[++i];
+            recolor_output = argv[++i];
+        } else if (std::string(argv[i]) == "--palette" && i + 1 < argc) {
+            palette_file = argv[++i];
+        } else if (std::string(argv[i]) == "--workers" && i + 1 < argc) {
+            batch_workers = std::atoi(argv[++i]);
+        } else if (std::string(argv[i]) == "--check-ms") {
+            check_ms = true;
+        }
+    }
+    // doesn't need the config at all
+    if (recolor_input) return recolor_escape_file(recolor_input, recolor_output, palette_file, batch_workers) ? 0 : 1;
     App app;
     AppState& state = app.state;
-    load_state(app, std::filesystem::absolute("mandelconfig"));
+    if (check_ms) {
+        // the gpu pass on the default view and settings (progressive on),
+        // against a plain render of it
+        state.mariani_silver = true;
+        state.ms_verify = true;
+    } else {
+        load_state(app, std::filesystem::absolute("mandelconfig"));
+    }
+    // headless: jobs start from the saved state, no window is opened
+    if (batch_file) {
+        std::vector<BatchJob> jobs;
+        if (!load_jobs(batch_file, state, jobs)) return -1;
+        return run_batch(jobs, batch_workers) == 0 ? 0 : 1;
+    }
+    if (animation_file) {
+        Animation anim;
+        if (!load_animation(animation_file, state, anim)) return -1;
+        return render_animation(anim, batch_workers) ? 0 : 1;
+    }
     /* GLFW */
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -110,23 +203,65 @@ int main(int argc, char** argv) {
     // Mix_Music* music = Mix_LoadMUS_RW(rw, 1);
     // Mix_PlayMusic(music, -1);
 
+    // link() only starts each program, the driver compiles them side by side
+    // (or loads them from the cache) while the passes below set up theirs
+    ShaderProgram::set_binary_cache(std::filesystem::absolute("shadercache"));
     ShaderProgram fractal_shader;
     if (!fractal_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
     if (!fractal_shader.attach_from_string(GL_FRAGMENT_SHADER, fractal_pass_fragment_str)) return -1;
     fractal_shader.link();
-    fractal_shader.use();
     
+    ShaderProgram fractal_float_shader;
+    if (!fractal_float_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
+    if (!fractal_float_shader.attach_from_string(GL_FRAGMENT_SHADER, fractal_float_pass_fragment_str)) return -1;
+    fractal_float_shader.link();
+
+    ShaderProgram fractal_ff_shader;
+    if (!fractal_ff_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
+    if (!fractal_ff_shader.attach_from_string(GL_FRAGMENT_SHADER, fractal_ff_pass_fragment_str)) return -1;
+    fractal_ff_shader.link();
+
+    ShaderProgram perturbation_shader;
+    if (!perturbation_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
+    if (!perturbation_shader.attach_from_string(GL_FRAGMENT_SHADER, perturbation_pass_fragment_str)) return -1;
+    perturbation_shader.link();
+
+    ShaderProgram perturbation_fe_shader;
+    if (!perturbation_fe_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
+    if (!perturbation_fe_shader.attach_from_string(GL_FRAGMENT_SHADER, perturbation_floatexp_pass_fragment_str)) return -1;
+    perturbation_fe_shader.link();
+
+    ShaderProgram reproject_shader;
+    if (!reproject_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
+    if (!reproject_shader.attach_from_string(GL_FRAGMENT_SHADER, reproject_pass_shader_str)) return -1;
+    reproject_shader.link();
+
     ShaderProgram palette_shader;
     if (!palette_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
     if (!palette_shader.attach_from_string(GL_FRAGMENT_SHADER, palette_pass_shader_str)) return -1;
     palette_shader.link();
-    palette_shader.use();
 
     ShaderProgram passthrough_shader;
     if (!passthrough_shader.attach_from_string(GL_VERTEX_SHADER, vertex_shader_str)) return -1;
     if (!passthrough_shader.attach_from_string(GL_FRAGMENT_SHADER, passthrough_fragment_shader_str)) return -1;
     passthrough_shader.link();
-    passthrough_shader.use();
+
+    ComputePass compute_pass;
+    bool compute_available = compute_pass.init();
+    if (!compute_available) state.use_compute = false;
+
+    MarianiSilverPass mariani_silver;
+    bool mariani_silver_gpu = mariani_silver.init(vertex_shader_str);
+    if (check_ms && !mariani_silver_gpu) return -1;
+
+    AdaptiveAA adaptive_aa;
+    if (!adaptive_aa.init(vertex_shader_str)) return -1;
+    bool aa_valid = false; // the sample list matches the image on screen
+
+    for (ShaderProgram* sp : {&fractal_shader, &fractal_float_shader, &fractal_ff_shader, &perturbation_shader,
+                              &perturbation_fe_shader, &reproject_shader, &palette_shader, &passthrough_shader}) {
+        if (!sp->linked()) return -1;
+    }
 
     float vertices[] = {
       // pos           // tex
@@ -153,21 +288,85 @@ int main(int argc, char** argv) {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(2*sizeof(float)));
 
-    glUniform1i(fractal_shader.uniform_location("iterations"), state.max_iterations);
-
     
     // std::thread renderer(renderThread, &app);
 
     // glfwSwapInterval(0); // disable vsync
 
-    FrameBuffer fractal_fbuffer(state.width * 2, state.height * 2, FrameBuffer::Format::R32F, false);
-    FrameBuffer paletted_fbuffer{state.width * 2, state.height * 2, FrameBuffer::Format::RGB8, false};
+    FrameBuffer fractal_fbuffer(state.width, state.height, FrameBuffer::Format::R32F, false);
+    FrameBuffer paletted_fbuffer{state.width, state.height, FrameBuffer::Format::RGB8, false};
 
     Palette palette(&app.state.palette_state);
-    palette.update_filter();
-    
+
+    // progressive refinement levels, 1/2 .. 1/COARSEST_LEVEL resolution
+    const int COARSEST_LEVEL = 8;
+    FrameBuffer level_fbuffers[3] = {
+        FrameBuffer(1, 1, FrameBuffer::Format::R32F, false),
+        FrameBuffer(1, 1, FrameBuffer::Format::R32F, false),
+        FrameBuffer(1, 1, FrameBuffer::Format::R32F, false),
+    };
+    auto level_fbuffer = [&](int step) -> FrameBuffer& {
+        return step == 1 ? fractal_fbuffer : level_fbuffers[step == 2 ? 0 : step == 4 ? 1 : 2];
+    };
+    int level_step = 1; // level on screen, 1 = full resolution
+
+    // for shifting the escape buffer on pans
+    FrameBuffer shift_fbuffer(1, 1, FrameBuffer::Format::R32F, false);
+    EscapeBufferView shown_view;
+    // zoom previews, see reproject_pass.frag
+    FrameBuffer reproject_fbuffer(1, 1, FrameBuffer::Format::R32F, false);
+    int reproject_phase = 0;
+    int reproject_pending = 0; // phases left until every texel is exact again
+    // a level the gpu hasn't finished yet, continued on the next frames
+    TimeSlicer slicer;
+    bool slice_refine = false, slice_reproject = false;
+    // temporal accumulation: running mean of jittered frames while idle
+    FrameBuffer sample_fbuffer(1, 1, FrameBuffer::Format::R32F, false);
+    FrameBuffer accum_fbuffer(1, 1, FrameBuffer::Format::RGBA32F, false);
+    std::vector<float> cpu_sample;
+    int accum_count = 0;
+    // with a palette that moves over time, only this many frames are
+    // averaged. Their escape values are kept, so once they are all in the
+    // mean is recolored every frame instead of rendered again.
+    const int ANIMATED_ACCUMULATION = 16;
+    std::vector<std::unique_ptr<FrameBuffer>> animated_samples;
+    // Mariani-Silver diagnostics
+    FrameBuffer verify_fbuffer(1, 1, FrameBuffer::Format::R32F, false);
+    std::vector<float> verify_escape;
+    long long ms_mismatches = -1; // vs brute force, -1 if not checked
+    bool check_failed = false;   // --check-ms
+    MarianiSilverStats ms_stats;
+
+    std::vector<float> cpu_escape;
+    TileScheduler cpu_scheduler;
+    ReferenceOrbit reference;
+    OrbitBuffer orbit_buffer;
+    // escape tiles of finished views, kept across runs
+    TileCache tile_cache;
+    const std::filesystem::path tile_cache_path = std::filesystem::absolute("tilecache");
+    if (state.tile_cache) tile_cache.open(tile_cache_path, (size_t)state.tile_cache_mb << 20);
+
+    // escape values -> colors (with aa and accumulation) -> window
+    RenderGraph graph;
+    const int fractal_node = graph.add_pass("fractal", INPUT_CAMERA | INPUT_ITERATIONS | INPUT_WINDOW);
+    const int color_node = graph.add_pass("color", INPUT_PALETTE | INPUT_TIME | INPUT_ITERATIONS | INPUT_WINDOW | INPUT_QUALITY, fractal_node);
+    const int present_node = graph.add_pass("present", INPUT_WINDOW | INPUT_UI, color_node);
+    FrameInputs last_inputs(state);
+    unsigned frame_changes = INPUT_ALL;
+    // imgui needs a couple of frames to catch up with an event (hover, popups)
+    const int UI_FRAMES = 3;
+    int ui_frames = 0;
+
     while (!glfwWindowShouldClose(app.window)) {
-        glfwPollEvents();             // Process events
+        // a frame that changed something is followed by one more, a held key
+        // or auto zoom changes it again. After that, an image that is
+        // finished waits for the next event instead of being redrawn.
+        if (graph.idle() && frame_changes == 0) {
+            glfwWaitEvents();
+            ui_frames = UI_FRAMES;
+        } else {
+            glfwPollEvents();
+        }
         
         if (is_pressed(app.window, GLFW_KEY_ESCAPE)) break;
 
@@ -186,79 +385,506 @@ int main(int argc, char** argv) {
             palette.draw_ui();
             imgui_camera_ui(app);
             ImGui::SeparatorText("Graphics");
-            if (ImGui::Checkbox("SSAA", &state.use_ssaa)) state.dirty_fractal = true;
+            if (ImGui::Checkbox("AA", &state.antialias)) aa_valid = false;
             ImGui::SameLine();
-            if (ImGui::Checkbox("Smooth coloring", &state.palette_state.use_smooth)) palette.update_filter();
+            if (ImGui::Checkbox("CPU", &state.use_cpu)) state.dirty_fractal = true;
+            ImGui::SameLine();
+            if (compute_available) {
+                if (ImGui::Checkbox("Compute", &state.use_compute)) state.dirty_fractal = true;
+                ImGui::SameLine();
+            }
+            if (ImGui::Checkbox("Smooth coloring", &state.palette_state.use_smooth)) {
+                // decides which borders count as uniform
+                if (state.mariani_silver) state.dirty_fractal = true;
+            }
+            if (ImGui::Checkbox("Progressive", &state.progressive)) state.dirty_fractal = true;
+            if (state.antialias) {
+                if (ImGui::SliderInt("##aa_samples", &state.aa_samples, 2, 64, "AA samples = %d")) aa_valid = false;
+                if (ImGui::SliderFloat("##aa_threshold", &state.aa_threshold, 0.0f, 0.5f, "AA threshold = %.3f")) aa_valid = false;
+                if (aa_valid) {
+                    ImGui::TextDisabled("%d edge px (%.1f%%)", adaptive_aa.edges(),
+                                        100.0 * adaptive_aa.edges() / ((double)state.width * state.height));
+                }
+            }
+            ImGui::Checkbox("Accumulate", &state.accumulate);
+            if (state.accumulate) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%d", accum_count);
+                ImGui::SliderInt("##accumulate_samples", &state.accumulate_samples, 16, 256, "Accumulate frames = %d");
+            }
+            if (ImGui::Checkbox("Tile cache", &state.tile_cache)) {
+                if (state.tile_cache) tile_cache.open(tile_cache_path, (size_t)state.tile_cache_mb << 20);
+                else tile_cache.close();
+            }
+            if (tile_cache.is_open()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%d/%d tiles, %d queued", tile_cache.tiles(), tile_cache.capacity(), tile_cache.queued());
+            }
+            if (state.use_cpu || mariani_silver_gpu) {
+                if (ImGui::Checkbox("Mariani-Silver", &state.mariani_silver)) state.dirty_fractal = true;
+                if (state.mariani_silver) {
+                    ImGui::SameLine();
+                    if (ImGui::Checkbox("Verify", &state.ms_verify)) state.dirty_fractal = true;
+                    if (ImGui::SliderInt("##guard", &state.ms_guard, 0, 4, "Guard band = %d")) state.dirty_fractal = true;
+                    if (state.use_cpu && ms_stats.computed + ms_stats.filled > 0) {
+                        ImGui::TextDisabled("%.1f%% filled", 100.0 * ms_stats.filled / (ms_stats.computed + ms_stats.filled));
+                    }
+                    if (state.ms_verify && ms_mismatches >= 0) ImGui::TextDisabled("%lld px differ from brute force", ms_mismatches);
+                }
+            }
+            if (!state.use_cpu && !state.use_compute && !use_perturbation(state)) {
+                ImGui::TextDisabled("%s shader", shader_precision_name(shader_precision(state)));
+            }
+            if (!state.use_cpu && !state.use_compute) {
+                if (ImGui::Checkbox("Time slice", &state.time_slice)) {
+                    // a half-issued level would never finish on the other path
+                    slicer.cancel();
+                    state.dirty_fractal = true;
+                }
+                if (state.time_slice) {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled("%d tiles left, %.1f ms", slicer.tiles_left(), slicer.last_gpu_ms());
+                    ImGui::SliderFloat("##gpu_budget", &state.gpu_budget_ms, 1.0f, 50.0f, "GPU budget = %.1f ms");
+                }
+            }
+            if (state.use_cpu) {
+                ImGui::Text("%s, %d threads, %dpx tiles, %.1f ms", cpu_kernel_name(cpu_detect_kernel()),
+                            cpu_scheduler.num_threads(), cpu_scheduler.tile_size(), cpu_scheduler.last_run_ms());
+                const char* numerics[] = {"Auto", "float", "double", "double-double", "quad-double"};
+                int numeric = (int)state.cpu_numeric;
+                if (ImGui::Combo("##numeric", &numeric, numerics, IM_ARRAYSIZE(numerics))) {
+                    state.cpu_numeric = (Numeric)numeric;
+                    state.dirty_fractal = true;
+                }
+                if (state.cpu_numeric == Numeric::Auto && !use_perturbation(state)) {
+                    ImGui::TextDisabled("(%s)", numeric_name(select_numeric(state.zoom.to_double(), supersampled_height(state))));
+                }
+            }
             ImGui::Separator();
             ImGui::Text("%.1f FPS", imGuiIO.Framerate);
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s%s%s", graph.ran(fractal_node) ? "fractal " : "",
+                                graph.ran(color_node) ? "color " : "", graph.ran(present_node) ? "present" : "");
             
             ImGui::End();
         }
         
         update_camera(app);
-        palette.generate(state.max_iterations + 1);
+        // only rewritten when it changed or moves with time
+        palette.generate(state.max_iterations + 1, (float)ImGui::GetTime());
         update_uniforms(app, fractal_shader);
 
+        FrameInputs inputs(state);
+        frame_changes = inputs.changed(last_inputs);
+        last_inputs = inputs;
+        if (state.dirty_fractal) frame_changes |= INPUT_CAMERA;
+        state.dirty_fractal = false;
+        if (palette.animated()) frame_changes |= INPUT_TIME;
+        if (ui_frames > 0) {
+            frame_changes |= INPUT_UI;
+            ui_frames--;
+        }
+        graph.invalidate(frame_changes);
+
         {
-            glClearColor(0.12f, 0.1f, 0.12f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT);
-            
+            // antialiasing adds samples where needed, see adaptive_aa.h
             int fractal_res_width = state.width;
             int fractal_res_height = state.height;
-            if (state.use_ssaa) {
-                fractal_res_width *= 2;
-                fractal_res_height *= 2;
-            }
             
             // first pass (iterations)
-            if (state.dirty_fractal) {
-                state.dirty_fractal = false;
+            bool deep = use_perturbation(state);
+            ShaderPrecision precision = shader_precision(state);
+            // the cpu's perturbation path and the compute shader don't subdivide
+            ShaderProgram& sp = deep ? (state.zoom > FLOATEXP_ZOOM_THRESHOLD ? perturbation_fe_shader : perturbation_shader)
+                              : precision == ShaderPrecision::Float ? fractal_float_shader
+                              : precision == ShaderPrecision::FloatFloat ? fractal_ff_shader : fractal_shader;
+            bool ms = state.mariani_silver && !state.use_compute && !(state.use_cpu && deep) &&
+                      (state.use_cpu || mariani_silver_gpu);
+            // which renderer fills the buffer, pans only reuse pixels from the same one
+            int pass = state.use_cpu ? (deep ? 0 : 1 + (int)state.cpu_numeric)
+                     : state.use_compute ? 10 : deep ? 11 : 12 + (int)precision;
+            if (ms) pass += 100;
+
+            // a camera change restarts at the coarsest level, each later
+            // frame renders the next finer one until full resolution.
+            // a pan by whole pixels shifts the finished image instead and
+            // only computes the strips that came into view.
+            // zooms on the gpu reuse the previous image as well, resampled
+            // under the new camera, and recompute a quarter of it per frame.
+            // a level spread over frames by the time slicer finishes before
+            // the next one starts.
+            bool render_level = false, shift = false, reproject = false, resume = false, cached = false;
+            int shift_x = 0, shift_y = 0;
+            float reproject_transform[4] = {1.0f, 1.0f, 0.0f, 0.0f};
+            if (!graph.begin(fractal_node)) {
+                // the escape buffer is finished and still matches the view
+            } else if (graph.changed(fractal_node)) {
+                slicer.cancel();
                 fractal_fbuffer.resize(fractal_res_width, fractal_res_height); // TODO: move to callback
-                fractal_fbuffer.bind();
+                // a view whose tiles are all cached is sampled from them, nothing to iterate
+                if (state.tile_cache && tile_cache.is_open() && !deep) {
+                    cpu_escape.resize((size_t)fractal_res_width * fractal_res_height);
+                    // it keeps the renderer's pass, so the next pan or zoom can still reuse it
+                    cached = tile_cache.sample(escape_view(state), fractal_res_width, fractal_res_height, cpu_escape.data());
+                }
+                // Mariani-Silver always renders the whole frame, its fills would go stale under a shift
+                bool reusable = !cached && level_step == 1 && pass == shown_view.pass && !state.use_compute && !(state.use_cpu && deep) && !ms;
+                shift = reusable && pixel_shift(state, shown_view, fractal_res_width, fractal_res_height, shift_x, shift_y);
+                reproject = reusable && !shift && !state.use_cpu && state.progressive &&
+                            reprojection(state, shown_view, fractal_res_width, fractal_res_height, reproject_transform);
+                if (reproject) reproject_pending = 4;
+                else if (!shift) reproject_pending = 0;
+                // the cpu and compute paths always render at full resolution
+                level_step = state.progressive && !cached && !shift && !reproject && !state.use_cpu && !state.use_compute && !ms ? COARSEST_LEVEL : 1;
+                render_level = true;
+            } else if (slicer.pending()) {
+                reproject = slice_reproject;
+                resume = render_level = true;
+            } else if (level_step > 1) {
+                level_step /= 2;
+                render_level = true;
+            } else if (reproject_pending > 0) {
+                // camera is still, finish the remaining phases in place
+                reproject = render_level = true;
+            }
+            if (render_level) {
+                FrameBuffer& target = level_fbuffer(level_step);
+                int level_width = (fractal_res_width + level_step - 1) / level_step;
+                int level_height = (fractal_res_height + level_step - 1) / level_step;
+                // Mariani-Silver's passes bind their marked texture on unit 0, not a coarser level
+                bool refine = resume ? slice_refine : level_step < COARSEST_LEVEL && state.progressive && !shift && !reproject && !ms;
+                if (level_step > 1) target.resize(level_width, level_height);
+                if (refine) {
+                    glActiveTexture(GL_TEXTURE0);
+                    level_fbuffer(level_step * 2).bind_texture();
+                }
+
+                // parts of the level to compute
+                std::vector<Tile> regions = {{0, 0, level_width, level_height}};
+                if (shift) {
+                    // new pixel (x, y) is old pixel (x + shift_x, y + shift_y)
+                    int keep_w = fractal_res_width - std::abs(shift_x), keep_h = fractal_res_height - std::abs(shift_y);
+                    int keep_x = std::max(0, -shift_x), keep_y = std::max(0, -shift_y);
+                    regions.clear();
+                    regions.push_back({shift_x > 0 ? keep_w : 0, 0, std::abs(shift_x), fractal_res_height});
+                    regions.push_back({keep_x, shift_y > 0 ? keep_h : 0, keep_w, std::abs(shift_y)});
+                    if (state.use_cpu) {
+                        // rows are walked in the direction that doesn't overwrite unread ones
+                        for (int i = 0; i < keep_h; i++) {
+                            int y = shift_y > 0 ? keep_y + i : keep_y + keep_h - 1 - i;
+                            float* row = cpu_escape.data() + (size_t)y * fractal_res_width;
+                            std::memmove(row + keep_x, row + (std::ptrdiff_t)shift_y * fractal_res_width + keep_x + shift_x, keep_w * sizeof(float));
+                        }
+                    } else {
+                        shift_fbuffer.resize(fractal_res_width, fractal_res_height);
+                        glCopyImageSubData(fractal_fbuffer.texture_id, GL_TEXTURE_2D, 0, keep_x + shift_x, keep_y + shift_y, 0,
+                                           shift_fbuffer.texture_id, GL_TEXTURE_2D, 0, keep_x, keep_y, 0, keep_w, keep_h, 1);
+                        glCopyImageSubData(shift_fbuffer.texture_id, GL_TEXTURE_2D, 0, keep_x, keep_y, 0,
+                                           fractal_fbuffer.texture_id, GL_TEXTURE_2D, 0, keep_x, keep_y, 0, keep_w, keep_h, 1);
+                    }
+                }
+
+                if (deep && reference_is_stale(reference, state.center_x, state.center_y, state.zoom, state.max_iterations)) {
+                    compute_reference_orbit(reference, state.center_x, state.center_y, state.zoom, state.max_iterations);
+                    orbit_buffer.upload(reference);
+                }
+                if (cached) {
+                    fractal_fbuffer.upload(cpu_escape.data());
+                } else if (state.use_cpu) {
+                    cpu_escape.resize((size_t)fractal_res_width * fractal_res_height);
+                    if (deep) {
+                        cpu_render_perturbed(reference, deep_view(state, reference), cpu_escape.data(), fractal_res_width, fractal_res_height, cpu_scheduler);
+                    } else if (ms) {
+                        MarianiSilverOptions options;
+                        options.integer_bands = !state.palette_state.use_smooth;
+                        options.guard = state.ms_guard;
+                        cpu_render_mariani_silver(escape_view(state), cpu_escape.data(), fractal_res_width, fractal_res_height, cpu_scheduler, options, &ms_stats);
+                        if (state.ms_verify) {
+                            verify_escape.resize(cpu_escape.size());
+                            cpu_render_escape(escape_view(state), verify_escape.data(), fractal_res_width, fractal_res_height, cpu_scheduler);
+                            ms_mismatches = mariani_silver_mismatches(cpu_escape.data(), verify_escape.data(), cpu_escape.size(), options.integer_bands);
+                        }
+                    } else if (shift) {
+                        // the strips are thin, one thread is plenty
+                        for (const Tile& r : regions) {
+                            if (r.w > 0 && r.h > 0) cpu_render_rect(escape_view(state), cpu_detect_kernel(), cpu_escape.data(), fractal_res_width, fractal_res_height, r.x0, r.y0, r.w, r.h);
+                        }
+                    } else {
+                        cpu_render_escape(escape_view(state), cpu_escape.data(), fractal_res_width, fractal_res_height, cpu_scheduler);
+                    }
+                    fractal_fbuffer.upload(cpu_escape.data());
+                } else if (state.use_compute) {
+                    compute_pass.program.use();
+                    update_uniforms(app, compute_pass.program);
+                    compute_pass.dispatch(fractal_fbuffer.texture_id, fractal_res_width, fractal_res_height);
+                } else {
+                    if (reproject && resume) {
+                        glActiveTexture(GL_TEXTURE0);
+                        reproject_fbuffer.bind_texture();
+                    } else if (reproject) {
+                        reproject_phase = (reproject_phase + 1) % 4;
+                        reproject_pending--;
+                        reproject_fbuffer.resize(fractal_res_width, fractal_res_height);
+                        reproject_fbuffer.bind();
+                        glViewport(0, 0, fractal_res_width, fractal_res_height);
+                        reproject_shader.use();
+                        glActiveTexture(GL_TEXTURE0);
+                        fractal_fbuffer.bind_texture();
+                        glUniform1i(reproject_shader.uniform_location("previous"), 0);
+                        glUniform4fv(reproject_shader.uniform_location("transform"), 1, reproject_transform);
+                        glUniform1i(reproject_shader.uniform_location("phase"), reproject_phase);
+                        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                        reproject_fbuffer.bind_texture(); // `coarser` for the fractal pass
+                    }
+                    target.bind();
+                    glViewport(0, 0, level_width, level_height);
+                    sp.use();
+                    if (deep) {
+                        update_perturbation_uniforms(app, sp, reference);
+                        orbit_buffer.bind(0);
+                    } else {
+                        update_uniforms(app, sp);
+                    }
+                    // Mariani-Silver draws in reproject mode too, the passes mark what to iterate
+                    update_level_uniforms(sp, level_step, fractal_res_width, fractal_res_height, refine, reproject || ms);
+                    if (ms) {
+                        bool integer_bands = !state.palette_state.use_smooth;
+                        mariani_silver.render(fractal_fbuffer, fractal_res_width, fractal_res_height, state.ms_guard, integer_bands,
+                                              state.max_iterations, [&] {
+                            sp.use();
+                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                        });
+                        if (state.ms_verify) {
+                            verify_fbuffer.resize(fractal_res_width, fractal_res_height);
+                            verify_fbuffer.bind();
+                            glViewport(0, 0, fractal_res_width, fractal_res_height);
+                            sp.use();
+                            glUniform1i(sp.uniform_location("refine"), false);
+                            glUniform1i(sp.uniform_location("reproject"), false);
+                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                            cpu_escape.resize((size_t)fractal_res_width * fractal_res_height);
+                            verify_escape.resize(cpu_escape.size());
+                            fractal_fbuffer.download(cpu_escape.data());
+                            verify_fbuffer.download(verify_escape.data());
+                            ms_mismatches = mariani_silver_mismatches(cpu_escape.data(), verify_escape.data(), cpu_escape.size(), integer_bands);
+                        }
+                    } else if (state.time_slice) {
+                        if (!resume) {
+                            // until their tiles come in, pixels show the coarser level
+                            if (refine) {
+                                FrameBuffer& coarser = level_fbuffer(level_step * 2);
+                                int coarser_width = (fractal_res_width + 2 * level_step - 1) / (2 * level_step);
+                                int coarser_height = (fractal_res_height + 2 * level_step - 1) / (2 * level_step);
+                                glBindFramebuffer(GL_READ_FRAMEBUFFER, coarser.id);
+                                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.id);
+                                glBlitFramebuffer(0, 0, coarser_width, coarser_height, 0, 0, 2 * coarser_width, 2 * coarser_height,
+                                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                                target.bind();
+                            } else if (reproject) {
+                                // the resampled image, its missing texels show the first palette color meanwhile
+                                glBindFramebuffer(GL_READ_FRAMEBUFFER, reproject_fbuffer.id);
+                                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.id);
+                                glBlitFramebuffer(0, 0, level_width, level_height, 0, 0, level_width, level_height,
+                                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                                target.bind();
+                            } else if (!shift) {
+                                // nothing coarser to show, better blank than the previous camera's image
+                                const float zero = 0.0f;
+                                glClearBufferfv(GL_COLOR, 0, &zero);
+                            }
+                            slicer.start(regions, level_width / 2, level_height / 2);
+                            slice_refine = refine;
+                            slice_reproject = reproject;
+                        }
+                        slicer.run(state.gpu_budget_ms, [] { glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); });
+                    } else {
+                        glEnable(GL_SCISSOR_TEST);
+                        for (const Tile& r : regions) {
+                            if (r.w <= 0 || r.h <= 0) continue;
+                            glScissor(r.x0, r.y0, r.w, r.h);
+                            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                        }
+                        glDisable(GL_SCISSOR_TEST);
+                    }
+                }
+
+                if (level_step == 1 && !slicer.pending()) {
+                    shown_view = {true, state.center_x, state.center_y, state.zoom,
+                                  fractal_res_width, fractal_res_height, state.max_iterations, pass};
+                    // the cpu fills in the cache behind it, coming back here is then instant
+                    if (!cached && state.tile_cache && tile_cache.is_open() && !deep) {
+                        tile_cache.prefetch(escape_view(state), fractal_res_width, fractal_res_height);
+                    }
+                } else {
+                    shown_view.valid = false;
+                }
+            }
+            if (check_ms && ms_mismatches >= 0) {
+                // a filament slipping past the guard band is fine, whole blocks of wrong texels aren't
+                long long allowed = (long long)fractal_res_width * fractal_res_height / 1000;
+                std::cout << "Mariani-Silver: " << ms_mismatches << " px differ from brute force" << std::endl;
+                check_failed = ms_mismatches > allowed;
+                break;
+            }
+            // the next level, the rest of a sliced one, or reprojection phases left
+            if (level_step > 1 || slicer.pending() || reproject_pending > 0) graph.request(fractal_node);
+            // second pass (color)
+            auto palette_pass = [&](FrameBuffer& escape, FrameBuffer& out, bool antialias) {
+                out.resize(fractal_res_width, fractal_res_height);
+                out.bind();
                 glViewport(0, 0, fractal_res_width, fractal_res_height);
-                fractal_shader.use();
+                palette_shader.use();
+                glActiveTexture(GL_TEXTURE0);
+                escape.bind_texture();
+                palette.bind(palette_shader, 1);
+                glUniform1i(palette_shader.uniform_location("iterTex"), 0);
+                glUniform1i(palette_shader.uniform_location("iterations"), state.max_iterations);
+                glUniform1i(palette_shader.uniform_location("antialias"), antialias);
+                if (antialias) adaptive_aa.bind(palette_shader);
                 glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            };
+            if (graph.begin(color_node)) {
+                // a new palette or new settings throw the averaged colors away
+                if (graph.changed(color_node) & (INPUT_PALETTE | INPUT_ITERATIONS | INPUT_QUALITY)) accum_count = 0;
+                // once the image is finished and the camera stays put, find its
+                // edges and sample them (any render throws the samples away)
+                if (render_level) {
+                    aa_valid = false;
+                } else if (state.antialias && !aa_valid && level_step == 1) {
+                    palette_pass(fractal_fbuffer, paletted_fbuffer, false);
+                    adaptive_aa.find_edges(fractal_fbuffer, paletted_fbuffer, fractal_res_width, fractal_res_height,
+                                           state.max_iterations, state.aa_threshold, state.aa_samples);
+                    if (state.use_cpu && !deep) {
+                        adaptive_aa.render_samples(escape_view(state), cpu_scheduler);
+                    } else {
+                        sp.use();
+                        if (deep) {
+                            update_perturbation_uniforms(app, sp, reference);
+                            orbit_buffer.bind(0);
+                        } else {
+                            update_uniforms(app, sp);
+                        }
+                        update_level_uniforms(sp, 1, fractal_res_width, fractal_res_height, false);
+                        adaptive_aa.render_samples(sp);
+                    }
+                    aa_valid = true;
+                    accum_count = 0; // started from the image without them
+                }
+                palette_pass(level_fbuffer(level_step), paletted_fbuffer, state.antialias && aa_valid);
+
+                // Temporal accumulation: from the finished image on, each still
+                // frame renders every pixel once more at the next sub-pixel offset
+                // and blends its colors into the running mean.
+                bool palette_animated = palette.animated();
+                int accum_window = palette_animated ? std::min(state.accumulate_samples, ANIMATED_ACCUMULATION) : state.accumulate_samples;
+                if (!state.accumulate || render_level || level_step > 1) {
+                    accum_count = 0;
+                } else if (accum_count == 0) {
+                    palette_pass(fractal_fbuffer, accum_fbuffer, state.antialias && aa_valid);
+                    accum_count = 1;
+                } else if (accum_count < accum_window) {
+                    FrameBuffer* sample = &sample_fbuffer;
+                    if (palette_animated) {
+                        while ((int)animated_samples.size() <= accum_count) {
+                            animated_samples.push_back(std::make_unique<FrameBuffer>(1, 1, FrameBuffer::Format::R32F, false));
+                        }
+                        sample = animated_samples[accum_count].get();
+                    }
+                    double dx, dy;
+                    AdaptiveAA::sample_offset(accum_count, dx, dy);
+                    if (state.use_cpu && !deep) {
+                        EscapeView view = escape_view(state);
+                        view.jitter_x = dx;
+                        view.jitter_y = dy;
+                        cpu_sample.resize((size_t)fractal_res_width * fractal_res_height);
+                        cpu_render_escape(view, cpu_sample.data(), fractal_res_width, fractal_res_height, cpu_scheduler);
+                        sample->resize(fractal_res_width, fractal_res_height);
+                        sample->upload(cpu_sample.data());
+                    } else {
+                        sample->resize(fractal_res_width, fractal_res_height);
+                        sample->bind();
+                        glViewport(0, 0, fractal_res_width, fractal_res_height);
+                        sp.use();
+                        if (deep) {
+                            update_perturbation_uniforms(app, sp, reference);
+                            orbit_buffer.bind(0);
+                        } else {
+                            update_uniforms(app, sp);
+                        }
+                        update_jitter_uniforms(sp, dx, dy, fractal_res_width, fractal_res_height);
+                        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                    }
+                    // mean += (sample - mean) / n
+                    glEnable(GL_BLEND);
+                    glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / std::min(accum_count + 1, accum_window));
+                    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+                    palette_pass(*sample, accum_fbuffer, false);
+                    glDisable(GL_BLEND);
+                    accum_count++;
+                } else if (palette_animated) {
+                    // all samples are in and only the palette moves: blend their colors again
+                    palette_pass(fractal_fbuffer, accum_fbuffer, state.antialias && aa_valid);
+                    glEnable(GL_BLEND);
+                    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+                    for (int k = 1; k < accum_window; k++) {
+                        glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (k + 1));
+                        palette_pass(*animated_samples[k], accum_fbuffer, false);
+                    }
+                    glDisable(GL_BLEND);
+                }
+                // edges left to sample, or frames left to average
+                if (level_step == 1 && ((state.antialias && !aa_valid) || (state.accumulate && accum_count < accum_window))) {
+                    graph.request(color_node);
+                }
             }
-            // second pass (color)
-            paletted_fbuffer.resize(fractal_res_width, fractal_res_height);
-            paletted_fbuffer.bind();
-            glClear(GL_COLOR_BUFFER_BIT);
-            glViewport(0, 0, fractal_res_width, fractal_res_height);
-            palette_shader.use();
-            glActiveTexture(GL_TEXTURE0);
-            fractal_fbuffer.bind_texture();
-            glActiveTexture(GL_TEXTURE1);
-            palette.bind_texture();
-            glUniform1i(palette_shader.uniform_location("iterTex"), 0);
-            glUniform1i(palette_shader.uniform_location("paletteTex"), 1);
-            glUniform1i(palette_shader.uniform_location("iterations"), state.max_iterations);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            
+
             // thirds pass (downsample, sometimes)
-            paletted_fbuffer.unbind();
-            glClear(GL_COLOR_BUFFER_BIT);
-            glViewport(0, 0, state.width, state.height);
-            passthrough_shader.use();
-            glActiveTexture(GL_TEXTURE0);
-            paletted_fbuffer.bind_texture();
-            glUniform1i(passthrough_shader.uniform_location("superTexture"), 0);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            if (graph.begin(present_node)) {
+                paletted_fbuffer.unbind();
+                glClearColor(0.12f, 0.1f, 0.12f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                glViewport(0, 0, state.width, state.height);
+                passthrough_shader.use();
+                glActiveTexture(GL_TEXTURE0);
+                if (accum_count > 0) accum_fbuffer.bind_texture();
+                else paletted_fbuffer.bind_texture();
+                glUniform1i(passthrough_shader.uniform_location("superTexture"), 0);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            }
         }
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // an unchanged frame keeps the one already on screen
+        if (graph.ran(present_node)) {
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            glfwSwapBuffers(app.window);      // Swap front and back buffers
+        }
+    }
 
-        glfwSwapBuffers(app.window);      // Swap front and back buffers
+    if (check_ms) {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImPlot::DestroyContext();
+        ImGui::DestroyContext();
+        glfwTerminate();
+        return check_failed ? 1 : 0;
     }
 
     save_state(app, std::filesystem::absolute("mandelconfig"));
 
     if (true) {
-        fractal_fbuffer.resize(1920*2, 1080*2);
-        paletted_fbuffer.resize(1920*2, 1080*2);
-        glViewport(0, 0, 1920*2, 1080*2);
+        // the current view through the double shader, like the window. 4k
+        // fits in one framebuffer, the tiled exporter is for --batch.
+        const int WALLPAPER_WIDTH = 1920*2, WALLPAPER_HEIGHT = 1080*2;
+        state.width = WALLPAPER_WIDTH;
+        state.height = WALLPAPER_HEIGHT;
+        fractal_fbuffer.resize(WALLPAPER_WIDTH, WALLPAPER_HEIGHT);
+        paletted_fbuffer.resize(WALLPAPER_WIDTH, WALLPAPER_HEIGHT);
+        glViewport(0, 0, WALLPAPER_WIDTH, WALLPAPER_HEIGHT);
         fractal_fbuffer.bind();
         fractal_shader.use();
-        glUniform2f(fractal_shader.uniform_location("resolution"), 16, 9);
+        update_uniforms(app, fractal_shader);
+        update_level_uniforms(fractal_shader, 1, WALLPAPER_WIDTH, WALLPAPER_HEIGHT, false);
+        glUniform1i(fractal_shader.uniform_location("sample_list"), false);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         // second pass (color)
         paletted_fbuffer.bind();
@@ -266,18 +892,26 @@ int main(int argc, char** argv) {
         palette_shader.use();
         glActiveTexture(GL_TEXTURE0);
         fractal_fbuffer.bind_texture();
-        glActiveTexture(GL_TEXTURE1);
-        palette.bind_texture();
+        palette.bind(palette_shader, 1);
         glUniform1i(palette_shader.uniform_location("iterTex"), 0);
-        glUniform1i(palette_shader.uniform_location("paletteTex"), 1);
         glUniform1i(palette_shader.uniform_location("iterations"), state.max_iterations);
+        glUniform1i(palette_shader.uniform_location("antialias"), false);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-        std::vector<unsigned char> pixels(1920*2*1080*2*3);
-        glReadBuffer(GL_COLOR_ATTACHMENT0); 
-        glReadPixels(0, 0, 1920*2, 1080*2, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-        stbi_flip_vertically_on_write(1);
-        stbi_write_png("/home/aki/.config/mandelpaper.png", 1920*2, 1080*2, 3, pixels.data(), 1920*2 * 3);
+        std::vector<unsigned char> pixels((size_t)WALLPAPER_WIDTH * WALLPAPER_HEIGHT * 3);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, WALLPAPER_WIDTH, WALLPAPER_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        // gl rows are bottom to top
+        for (int y = 0; y < WALLPAPER_HEIGHT / 2; y++) {
+            std::swap_ranges(pixels.begin() + (size_t)y * WALLPAPER_WIDTH * 3, pixels.begin() + (size_t)(y + 1) * WALLPAPER_WIDTH * 3,
+                             pixels.begin() + (size_t)(WALLPAPER_HEIGHT - 1 - y) * WALLPAPER_WIDTH * 3);
+        }
+        PngStream png;
+        if (png.open("/home/aki/.config/mandelpaper.png", WALLPAPER_WIDTH, WALLPAPER_HEIGHT)) {
+            png.write_rows(pixels.data(), WALLPAPER_HEIGHT);
+            png.close();
+        }
 
         // std::system("hyprshot -m window -m active -o ~/.config -f mandelpaper");
         std::system("waypaper --wallpaper ~/.config/mandelpaper.png");
@@ -0,0 +1,79 @@
+#include "mariani_silver_pass.h"
+
+#include <iostream>
+
+#include "shaders/mariani_silver_resolve_pass.frag"
+#include "shaders/mariani_silver_decide_pass.frag"
+
+static constexpr int LARGEST_BLOCK = 64;
+static constexpr float PENDING = -1e36f; // see mariani_silver_resolve_pass.frag
+
+MarianiSilverPass::MarianiSilverPass()
+    : marked(1, 1, FrameBuffer::Format::R32F, false), decisions(1, 1, FrameBuffer::Format::R32F, false) {}
+
+static void build(ShaderProgram& program, const char* vertex_source, const char* fragment_source) {
+    program.attach_from_string(GL_VERTEX_SHADER, vertex_source);
+    program.attach_from_string(GL_FRAGMENT_SHADER, fragment_source);
+    program.link();
+}
+
+bool MarianiSilverPass::init(const char* vertex_source) {
+    // both compile at once, see shader.h
+    build(resolve_program, vertex_source, mariani_silver_resolve_pass_shader_str);
+    build(decide_program, vertex_source, mariani_silver_decide_pass_shader_str);
+    if (!resolve_program.linked() || !decide_program.linked()) {
+        std::cerr << "Linking a Mariani-Silver pass failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void MarianiSilverPass::render(FrameBuffer& target, int width, int height, int guard, bool integer_bands, int iterations,
+                               const EscapePassFn& escape_pass) {
+    marked.resize(width, height);
+    target.bind();
+    glClearBufferfv(GL_COLOR, 0, &PENDING);
+
+    int parent_block = 0;
+    for (int block = LARGEST_BLOCK;; block /= 2) {
+        // once the borders would cover the whole block, iterate what's left
+        bool last = block <= 2 * guard + 2;
+
+        marked.bind();
+        glViewport(0, 0, width, height);
+        resolve_program.use();
+        glActiveTexture(GL_TEXTURE0);
+        target.bind_texture();
+        glActiveTexture(GL_TEXTURE1);
+        decisions.bind_texture();
+        glUniform1i(resolve_program.uniform_location("escape"), 0);
+        glUniform1i(resolve_program.uniform_location("decisions"), 1);
+        glUniform1i(resolve_program.uniform_location("parent_block"), parent_block);
+        glUniform1i(resolve_program.uniform_location("block"), last ? 0 : block);
+        glUniform1i(resolve_program.uniform_location("guard"), guard);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+        target.bind();
+        glActiveTexture(GL_TEXTURE0);
+        marked.bind_texture();
+        escape_pass(); // same viewport as the resolve pass
+        if (last) break;
+
+        int blocks_x = (width - 1 + block - 1) / block;
+        int blocks_y = (height - 1 + block - 1) / block;
+        decisions.resize(blocks_x, blocks_y);
+        decisions.bind();
+        glViewport(0, 0, blocks_x, blocks_y);
+        decide_program.use();
+        glActiveTexture(GL_TEXTURE0);
+        target.bind_texture();
+        glUniform1i(decide_program.uniform_location("escape"), 0);
+        glUniform1i(decide_program.uniform_location("block"), block);
+        glUniform1i(decide_program.uniform_location("guard"), guard);
+        glUniform1i(decide_program.uniform_location("iterations"), iterations);
+        glUniform1i(decide_program.uniform_location("integer_bands"), integer_bands);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        parent_block = block;
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
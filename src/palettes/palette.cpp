@@ -3,6 +3,8 @@
 #include "imgui.h"
 #include "implot.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <string>
 
@@ -10,66 +12,173 @@
 #include "constants.h"
 
 
+// cos for the palette loops: only float arithmetic, min and selects, so
+// the loops vectorize (at -O3). Reduced by 2*pi in two parts, folded onto
+// [0, pi/2] by symmetry, then Taylor to a^12: within ~2e-7 of std::cos.
+static inline float palette_cos(float x) {
+    const float INV_TWO_PI = 0.159154943f, TWO_PI_HI = 6.28125f, TWO_PI_LO = 1.9353071795864769e-3f;
+    const float HALF_PI = 1.57079633f, TWO_PI = 6.28318531f;
+    float k = (float)(int)(x * INV_TWO_PI);
+    float a = std::abs((x - k * TWO_PI_HI) - k * TWO_PI_LO); // [0, 2pi)
+    float b = TWO_PI - a;
+    a = b < a ? b : a;                                         // [0, pi]
+    float sign = a > HALF_PI ? -1.0f : 1.0f;
+    a = HALF_PI - std::abs(HALF_PI - a);                       // [0, pi/2]
+    float a2 = a * a;
+    float c = 1.0f + a2 * (-1.0f / 2 + a2 * (1.0f / 24 + a2 * (-1.0f / 720 + a2 * (1.0f / 40320 +
+              a2 * (-1.0f / 3628800 + a2 * (1.0f / 479001600))))));
+    return sign * c;
+}
+
+PaletteChannels::PaletteChannels(const PaletteState& state)
+    : reversed(state.reversed), override(state.override),
+      override_color{state.override_color.x, state.override_color.y, state.override_color.z} {
+    const char* names[3] = {"red", "green", "blue"};
+    for (int c = 0; c < 3; c++) {
+        // a missing channel is a default one, like channels[name] makes
+        auto it = state.channels.find(names[c]);
+        ChannelState channel = it != state.channels.end() ? it->second : ChannelState{};
+        y_scale[c] = channel.y_scale;
+        x_offset[c] = channel.x_offset;
+        x_scale[c] = channel.x_scale;
+        t_scale[c] = channel.t_scale;
+    }
+}
+
+bool PaletteChannels::operator==(const PaletteChannels& o) const {
+    for (int c = 0; c < 3; c++) {
+        if (y_scale[c] != o.y_scale[c] || x_offset[c] != o.x_offset[c] || x_scale[c] != o.x_scale[c] ||
+            t_scale[c] != o.t_scale[c]) {
+            return false;
+        }
+    }
+    if (override && (override_color[0] != o.override_color[0] || override_color[1] != o.override_color[1] ||
+                     override_color[2] != o.override_color[2])) {
+        return false;
+    }
+    return reversed == o.reversed && override == o.override;
+}
+
+bool PaletteChannels::animated() const { return t_scale[0] != 0.0f || t_scale[1] != 0.0f || t_scale[2] != 0.0f; }
+
+void PaletteChannels::evaluate(int c, int n, float time, float* out) const {
+    const float ys = y_scale[c], xo = x_offset[c], xs = x_scale[c], phase = t_scale[c] * time;
+    // entry j shows iteration first + step * j, exact in float up to 2^24 entries
+    const float first = reversed ? float(n - 1) : 0.0f, step = reversed ? -1.0f : 1.0f;
+    for (int j = 0; j < n; j++) {
+        float i = first + step * (float)j;
+        out[j] = ys * (0.5f + 0.5f * palette_cos(xo + i * xs + phase));
+    }
+    if (override && n > 0) out[n - 1] = override_color[c];
+}
+
+glm::vec3 PaletteChannels::at(int j, int n, float time) const {
+    if (override && j == n - 1) return glm::vec3(override_color[0], override_color[1], override_color[2]);
+    float i = reversed ? float(n - 1) - (float)j : (float)j;
+    float rgb[3];
+    for (int c = 0; c < 3; c++) rgb[c] = y_scale[c] * (0.5f + 0.5f * palette_cos(x_offset[c] + i * x_scale[c] + t_scale[c] * time));
+    return glm::vec3(rgb[0], rgb[1], rgb[2]);
+}
+
+void palette_colors(const PaletteState& state, int num_colors, float time, std::vector<glm::vec3>& colors) {
+    PaletteChannels channels(state);
+    std::vector<float> values((size_t)num_colors * 3);
+    for (int c = 0; c < 3; c++) channels.evaluate(c, num_colors, time, values.data() + (size_t)c * num_colors);
+    colors.resize(num_colors);
+    for (int i = 0; i < num_colors; i++) {
+        colors[i] = {values[i], values[(size_t)num_colors + i], values[(size_t)2 * num_colors + i]};
+    }
+}
+
 Palette::Palette(PaletteState* state) : state(state) {
     glGenTextures(1, &texture);
-    bind_texture();
-
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    float border_color[] = { 1.0f, 0.0f, 0.0f, 1.0f }; // to catch bugs
-    glTexParameterfv(GL_TEXTURE_1D, GL_TEXTURE_BORDER_COLOR, border_color);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-
-    // channels = std::vector<ChannelFn>{Fn("r", 1,0,0), Fn("g", 0,1,0), Fn("b", 0,0,1)};
-    // create color channels
-
-    // TODO: figure out where this logic show go?
-    if (state->channels.empty()) {
-        state->channels["red"].color.x = 1.0f;
-        state->channels["red"].x_scale = 0.23f;
-        state->channels["green"].color.y = 1.0f;
-        state->channels["green"].x_scale = 0.24f;
-        state->channels["blue"].color.z = 1.0f;
-        state->channels["blue"].x_scale = 0.25f;
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    max_entries = std::max(1, max_texels / 3);
+    default_channels(*state);
+}
+
+Palette::~Palette() {
+    for (GLsync& fence : fences) {
+        if (fence) glDeleteSync(fence);
     }
+    if (buffer) glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &texture);
+}
 
-    // Set the palette colors
-    // generate();
-    // glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, state->num_colors, 0, GL_RGB, GL_FLOAT, colors.data());
-    update_filter();
-    unbind_texture();
+void default_channels(PaletteState& state) {
+    if (!state.channels.empty()) return;
+    state.channels["red"].color.x = 1.0f;
+    state.channels["red"].x_scale = 0.23f;
+    state.channels["green"].color.y = 1.0f;
+    state.channels["green"].x_scale = 0.24f;
+    state.channels["blue"].color.z = 1.0f;
+    state.channels["blue"].x_scale = 0.25f;
 }
 
 void Palette::reverse() { state->reversed = !state->reversed; }
-void Palette::update_filter() {
-    bind_texture();
-    if (state->use_smooth) {
-        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    } else {
-        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+// Room for `entries` in each half. The storage is immutable, so growing
+// makes a new buffer (twice the size, so a rising iteration count doesn't
+// reallocate every frame).
+void Palette::reserve(int entries) {
+    if ((size_t)entries * 3 <= region_floats) return;
+    GLint alignment = 256;
+    glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t align_floats = std::max<size_t>(1, (size_t)alignment / sizeof(float));
+    size_t want = std::max((size_t)entries, std::min((size_t)max_entries, region_floats / 3 * 2)) * 3;
+    region_floats = (want + align_floats - 1) / align_floats * align_floats;
+
+    for (GLsync& fence : fences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
     }
-    unbind_texture();
+    if (buffer) glDeleteBuffers(1, &buffer); // gl keeps it alive until the gpu is done with it
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_TEXTURE_BUFFER, region_floats * 2 * sizeof(float), nullptr, flags);
+    mapped = (float*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, region_floats * 2 * sizeof(float), flags);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    region = 0;
+    valid = false;
 }
 
-void Palette::generate(int num_colors) {
-    colors.resize(num_colors);
-    for (int i = 0; i < num_colors; ++i) {
-        colors[state->reversed ? num_colors-1 - i : i] = {
-            state->channels["red"](i),
-            state->channels["green"](i),
-            state->channels["blue"](i)
-        };
+void Palette::generate(int num_colors, float t) {
+    int n = std::clamp(num_colors, 1, max_entries);
+    PaletteChannels now(*state);
+    if (valid && n == size && now == uploaded && (!now.animated() || t == time)) return;
+    reserve(n);
+    if (!mapped) return;
+    // switch to the half the gpu isn't reading, once it's done with it
+    if (valid) {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region ^= 1;
+    }
+    if (fences[region]) {
+        glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fences[region]);
+        fences[region] = nullptr;
     }
-    if (state->override) colors.back() = state->override_color;
-    bind_texture();
-    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, num_colors, 0, GL_RGB, GL_FLOAT, colors.data());
-    unbind_texture();
+    float* out = mapped + region * region_floats;
+    for (int c = 0; c < 3; c++) now.evaluate(c, n, t, out + (size_t)c * n);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32F, buffer, (GLintptr)(region * region_floats * sizeof(float)),
+                     (GLsizeiptr)((size_t)n * 3 * sizeof(float)));
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    uploaded = now;
+    size = n;
+    time = t;
+    valid = true;
 }
 
-void Palette::bind_texture() { glBindTexture(GL_TEXTURE_1D, texture); }
-void Palette::unbind_texture() { glBindTexture(GL_TEXTURE_1D, 0); }
+void Palette::bind(ShaderProgram& sp, int unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glUniform1i(sp.uniform_location("paletteTex"), unit);
+    glUniform1i(sp.uniform_location("paletteSize"), size);
+    glUniform1i(sp.uniform_location("smoothColors"), state->use_smooth);
+}
 
 void Palette::draw_ui() {
     ImGui::SeparatorText("Palette");
@@ -87,10 +196,12 @@ void Palette::draw_ui() {
         ImVec2 p0 = ImGui::GetCursorScreenPos(); // top left
         ImVec2 p1 = ImVec2(p0.x + rect_size.x, p0.y + rect_size.y); // bottom right
         
-        for (int i = 0; i < colors.size(); i++) {
-            glm::vec3 col = colors[i];
-            ImVec2 rect_p0(p0.x + (rect_size.x * i/colors.size()), p0.y);
-            ImVec2 rect_p1(p0.x + (rect_size.x * (i+1)/colors.size()), p1.y);
+        // at most a rect per pixel, the palette can have millions of entries
+        int rects = std::max(1, std::min(size, (int)rect_size.x));
+        for (int k = 0; k < rects; k++) {
+            glm::vec3 col = uploaded.at((int)((long long)k * size / rects), size, time);
+            ImVec2 rect_p0(p0.x + (rect_size.x * k/rects), p0.y);
+            ImVec2 rect_p1(p0.x + (rect_size.x * (k+1)/rects), p1.y);
             draw_list->AddRectFilled(rect_p0, rect_p1, IM_COL32(col.r*255, col.g*255, col.b*255, 255));
         }
         ImGui::InvisibleButton("##palette0", rect_size);
@@ -116,15 +227,19 @@ void Palette::draw_ui() {
         if (ImPlot::BeginPlot("##Line Plots", ImVec2(ImGui::CalcItemWidth(), 50), plotFlags)) {
             ImGui::Text("Hello!!");
             ImPlot::SetupAxes("iterations", "y", xflags, yflags);
-            // move to generate()? but we'd have to store all values in memory then..?
+            // sampled down to what the plot can show
+            const int PLOT_POINTS = 1000;
+            int points = std::min(size, PLOT_POINTS);
+            plot_x.resize(points);
+            plot_y.resize(points);
             for (auto& [name, channel] : state->channels) {
-                static float xs1[1001], ys1[1001];
-                for (int i = 0; i < colors.size(); ++i) {
-                    xs1[i] = i;
-                    ys1[i] = channel(state->reversed ? colors.size() - i - 1 : i);
+                for (int k = 0; k < points; ++k) {
+                    int i = (int)((long long)k * size / points);
+                    plot_x[k] = (float)i;
+                    plot_y[k] = channel.at(float(state->reversed ? size - i - 1 : i), time);
                 }
                 ImPlot::SetNextLineStyle(ImVec4(channel.color.x, channel.color.y, channel.color.z, 0.75));
-                ImPlot::PlotLine(name.c_str(), xs1, ys1, colors.size());
+                ImPlot::PlotLine(name.c_str(), plot_x.data(), plot_y.data(), points);
 
             }
             ImPlot::EndPlot();
@@ -145,7 +260,8 @@ void Palette::draw_ui() {
             ImGui::ColorEdit3("Static Set Color##set_color", (float*)&state->override_color, color_edit_flags);
         } else {
             ImGuiColorEditFlags color_edit_flags = ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel | ImGuiColorEditFlags_NoPicker;
-            ImGui::ColorEdit3("Set color##set_color", (float*)&colors.back(), color_edit_flags);
+            glm::vec3 last = uploaded.at(size - 1, size, time);
+            ImGui::ColorEdit3("Set color##set_color", (float*)&last, color_edit_flags);
         }
         ImGui::SameLine();
         ImGui::Checkbox("static", &state->override);
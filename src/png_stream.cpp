@@ -0,0 +1,185 @@
+#include "png_stream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "tile_scheduler.h"
+
+static constexpr size_t IDAT_SIZE = 1 << 18;
+
+static void put_u32(unsigned char* p, unsigned v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+PngStream::~PngStream() {
+    if (file) std::fclose(file);
+}
+
+bool PngStream::open(const std::string& path, int w, int h, int compression) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    width = w;
+    height = h;
+    rows = 0;
+    level = compression;
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    std::fwrite(signature, 1, 8, file);
+    unsigned char ihdr[13];
+    put_u32(ihdr, width);
+    put_u32(ihdr + 4, height);
+    ihdr[8] = 8;  // bits per channel
+    ihdr[9] = 2;  // rgb
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    if (!write_chunk("IHDR", ihdr, sizeof(ihdr))) return false;
+
+    previous.assign((size_t)width * 3, 0);
+    out.clear();
+    out.reserve(IDAT_SIZE);
+    adler = adler32(0, nullptr, 0);
+    // zlib header: deflate with a 32k window and the level (only a hint for
+    // decoders), the chunks are raw deflate
+    const unsigned char zlib_header[2] = {0x78, (unsigned char)(level == 1 ? 0x01 : 0x9C)};
+    return emit(zlib_header, 2);
+}
+
+bool PngStream::write_chunk(const char* type, const unsigned char* data, size_t size) {
+    unsigned char header[8];
+    put_u32(header, (unsigned)size);
+    std::memcpy(header + 4, type, 4);
+    uLong crc = crc32(0, header + 4, 4);
+    if (size) crc = crc32(crc, data, (uInt)size);
+    unsigned char footer[4];
+    put_u32(footer, (unsigned)crc);
+    bool ok = std::fwrite(header, 1, 8, file) == 8 && std::fwrite(data, 1, size, file) == size &&
+              std::fwrite(footer, 1, 4, file) == 4;
+    if (!ok) std::cerr << "Failed to write PNG chunk" << std::endl;
+    return ok;
+}
+
+// appends to the zlib stream, writing an IDAT whenever the buffer is full
+bool PngStream::emit(const unsigned char* data, size_t size) {
+    while (size > 0) {
+        size_t n = std::min(size, IDAT_SIZE - out.size());
+        out.insert(out.end(), data, data + n);
+        data += n;
+        size -= n;
+        if (out.size() == IDAT_SIZE) {
+            if (!write_chunk("IDAT", out.data(), out.size())) return false;
+            out.clear();
+        }
+    }
+    return true;
+}
+
+void PngStream::encode(const unsigned char* rgb, const unsigned char* above, int count, Chunk& chunk) const {
+    size_t stride = (size_t)width * 3;
+    std::vector<unsigned char> filtered((stride + 1) * count), candidate(stride + 1);
+    for (int r = 0; r < count; r++, rgb += stride) {
+        const unsigned char* prev = r ? rgb - stride : above;
+        unsigned char* best = filtered.data() + (stride + 1) * r;
+        // libpng's heuristic: the filter with the smallest sum of |signed bytes|
+        long best_sum = -1;
+        for (int filter = 0; filter < 5; filter++) {
+            candidate[0] = (unsigned char)filter;
+            long sum = 0;
+            // a loop per filter, so each one vectorizes
+            auto apply = [&](auto predict) {
+                for (size_t i = 0; i < stride; i++) {
+                    int a = i >= 3 ? rgb[i - 3] : 0, b = prev[i], c = i >= 3 ? prev[i - 3] : 0;
+                    unsigned char v = (unsigned char)(rgb[i] - predict(a, b, c));
+                    candidate[i + 1] = v;
+                    sum += v < 128 ? v : 256 - v;
+                }
+            };
+            switch (filter) {
+                case 0: apply([](int, int, int) { return 0; }); break;
+                case 1: apply([](int a, int, int) { return a; }); break;
+                case 2: apply([](int, int b, int) { return b; }); break;
+                case 3: apply([](int a, int b, int) { return (a + b) / 2; }); break;
+                default: apply(paeth); break;
+            }
+            if (best_sum < 0 || sum < best_sum) {
+                best_sum = sum;
+                std::memcpy(best, candidate.data(), stride + 1);
+            }
+        }
+    }
+    chunk.size = filtered.size();
+    chunk.adler = adler32(adler32(0, nullptr, 0), filtered.data(), (uInt)filtered.size());
+
+    z_stream zs{};
+    chunk.ok = deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    if (!chunk.ok) return;
+    // the bound is for Z_FINISH, a sync flush adds an empty stored block
+    chunk.data.resize(deflateBound(&zs, (uLong)filtered.size()) + 16);
+    zs.next_in = filtered.data();
+    zs.avail_in = (uInt)filtered.size();
+    zs.next_out = chunk.data.data();
+    zs.avail_out = (uInt)chunk.data.size();
+    chunk.ok = deflate(&zs, Z_SYNC_FLUSH) == Z_OK && zs.avail_in == 0 && zs.avail_out > 0;
+    chunk.data.resize(chunk.data.size() - zs.avail_out);
+    deflateEnd(&zs);
+}
+
+bool PngStream::write_rows(const unsigned char* rgb, int count, TileScheduler* scheduler) {
+    if (count <= 0) return true;
+    if (rows + count > height) {
+        std::cerr << "PNG stream got more rows than its height" << std::endl;
+        return false;
+    }
+    size_t stride = (size_t)width * 3;
+    // the band's rows as a 1-row "image", each tile a chunk
+    int per_chunk = scheduler ? scheduler->tile_size() : count;
+    chunks.resize((count + per_chunk - 1) / per_chunk);
+    auto encode_rows = [&](int first, int n) {
+        encode(rgb + stride * first, first ? rgb + stride * (first - 1) : previous.data(), n, chunks[first / per_chunk]);
+    };
+    if (scheduler) scheduler->run(count, 1, [&](const Tile& t) { encode_rows(t.x0, t.w); });
+    else encode_rows(0, count);
+
+    for (Chunk& chunk : chunks) {
+        if (!chunk.ok) {
+            std::cerr << "deflate failed" << std::endl;
+            return false;
+        }
+        if (!emit(chunk.data.data(), chunk.data.size())) return false;
+        adler = adler32_combine(adler, chunk.adler, (z_off_t)chunk.size);
+    }
+    std::memcpy(previous.data(), rgb + stride * (count - 1), stride);
+    rows += count;
+    return true;
+}
+
+bool PngStream::close() {
+    bool ok = file != nullptr;
+    if (ok && rows != height) {
+        std::cerr << "PNG stream closed after " << rows << " of " << height << " rows" << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        // an empty final block and the adler32 end the zlib stream
+        unsigned char tail[6] = {0x03, 0x00};
+        put_u32(tail + 2, (unsigned)adler);
+        ok = emit(tail, sizeof tail) && (out.empty() || write_chunk("IDAT", out.data(), out.size())) &&
+             write_chunk("IEND", nullptr, 0);
+    }
+    if (file && std::fclose(file) != 0) ok = false;
+    file = nullptr;
+    return ok;
+}
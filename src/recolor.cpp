@@ -0,0 +1,123 @@
+#include "recolor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "escape_file.h"
+#include "palette.h"
+#include "png_stream.h"
+#include "tile_scheduler.h"
+
+#ifdef MANDEL_X86_KERNELS
+// recolor_avx2.cpp, built with its own arch flags
+extern const RecolorFn recolor_fn_avx2;
+#endif
+
+RecolorPalette::RecolorPalette(const std::vector<glm::vec3>& colors, int iterations, bool smooth)
+    : iterations(iterations), smooth(smooth) {
+    for (const glm::vec3& c : colors) {
+        r.push_back(c.x);
+        g.push_back(c.y);
+        b.push_back(c.z);
+    }
+}
+
+static unsigned char quantize(float c) { return (unsigned char)std::clamp((int)(c * 255.0f + 0.5f), 0, 255); }
+
+// palette_color() and to_rgb8() from batch.cpp, on the split channels
+static void recolor_scalar(const RecolorPalette& p, const float* escape, int count, unsigned char* rgb) {
+    int n = (int)p.r.size();
+    for (int k = 0; k < count; k++) {
+        float t = (escape[k] - 0.5f) / float(p.iterations + 1);
+        float r, g, b;
+        if (!p.smooth) {
+            int i = (int)std::clamp(std::floor(t * n), 0.0f, float(n - 1));
+            r = p.r[i], g = p.g[i], b = p.b[i];
+        } else {
+            float u = t * n - 0.5f;
+            float fl = std::floor(u), f = u - fl;
+            int i0 = (int)std::clamp(fl, 0.0f, float(n - 1)), i1 = (int)std::clamp(fl + 1.0f, 0.0f, float(n - 1));
+            r = p.r[i0] + (p.r[i1] - p.r[i0]) * f;
+            g = p.g[i0] + (p.g[i1] - p.g[i0]) * f;
+            b = p.b[i0] + (p.b[i1] - p.b[i0]) * f;
+        }
+        rgb[3 * k + 0] = quantize(r);
+        rgb[3 * k + 1] = quantize(g);
+        rgb[3 * k + 2] = quantize(b);
+    }
+}
+
+RecolorFn cpu_recolor(CpuKernel kernel) {
+#ifdef MANDEL_X86_KERNELS
+    // avx-512 cpus all have avx2, and the gathers are the bottleneck either way
+    if (kernel != CpuKernel::Scalar) return recolor_fn_avx2;
+#endif
+    return recolor_scalar;
+}
+
+bool recolor_escape_file(const std::string& input, const std::string& output, const char* palette_file, int threads) {
+    auto start = std::chrono::steady_clock::now();
+    EscapeFile escape;
+    if (!escape.open(input)) return false;
+
+    // the palette the file was exported with, unless another file has one
+    nlohmann::json source = escape.params();
+    if (palette_file) {
+        std::ifstream f(palette_file);
+        if (!f.is_open()) {
+            std::cerr << "Failed to open palette file: " << palette_file << std::endl;
+            return false;
+        }
+        try {
+            nlohmann::json j = nlohmann::json::parse(f);
+            // a whole config, or just the palette_state object
+            source["palette_state"] = j.contains("palette_state") ? j.at("palette_state") : j;
+            source["time"] = j.value("time", 0.0f);
+        } catch (const nlohmann::json::exception& e) {
+            std::cerr << "Error parsing palette file " << palette_file << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+    PaletteState palette;
+    try {
+        palette = source.at("palette_state").get<PaletteState>();
+    } catch (const nlohmann::json::exception& e) {
+        std::cerr << "No palette for " << input << ": " << e.what() << std::endl;
+        return false;
+    }
+    default_channels(palette);
+    std::vector<glm::vec3> colors;
+    palette_colors(palette, escape.iterations() + 1, source.value("time", 0.0f), colors);
+    const RecolorPalette lookup(colors, escape.iterations(), palette.use_smooth);
+    const RecolorFn recolor = cpu_recolor(cpu_detect_kernel());
+
+    int width = escape.width(), height = escape.height(), tile = escape.tile();
+    int tiles_across = (width + tile - 1) / tile;
+    PngStream png;
+    // deflate is most of the time, so this trades a bigger png for speed
+    if (!png.open(output, width, height, Z_BEST_SPEED)) return false;
+    TileScheduler scheduler(threads);
+    scheduler.set_tile_size(16);
+    std::vector<unsigned char> band;
+    // a band of tiles at a time, each (tile, row) a span for the workers
+    for (int ty = 0; ty * tile < height; ty++) {
+        int band_height = std::min(tile, height - ty * tile);
+        band.resize((size_t)width * band_height * 3);
+        scheduler.run(tiles_across, band_height, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y0 + t.h; y++) {
+                for (int tx = t.x0; tx < t.x0 + t.w; tx++) {
+                    int x0 = tx * tile, w = std::min(tile, width - x0);
+                    recolor(lookup, escape.tile_data(tx, ty) + (size_t)y * tile, w, band.data() + ((size_t)y * width + x0) * 3);
+                }
+            }
+        });
+        if (!png.write_rows(band.data(), band_height, &scheduler)) return false;
+    }
+    if (!png.close()) return false;
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << output << ": " << width << "x" << height << " recolored in " << s << " s" << std::endl;
+    return true;
+}
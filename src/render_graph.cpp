@@ -0,0 +1,33 @@
+#include "render_graph.h"
+
+int RenderGraph::add_pass(const char* name, unsigned inputs, int reads) {
+    Pass p;
+    p.name = name;
+    p.inputs = inputs;
+    p.reads = reads;
+    p.pending = inputs; // everything is new on the first frame
+    passes.push_back(p);
+    return (int)passes.size() - 1;
+}
+
+void RenderGraph::invalidate(unsigned inputs) {
+    for (Pass& p : passes) p.pending |= p.inputs & inputs;
+}
+
+void RenderGraph::request(int pass) { passes[pass].requested = true; }
+
+bool RenderGraph::begin(int pass) {
+    Pass& p = passes[pass];
+    p.changed = p.pending;
+    p.pending = 0;
+    p.ran = p.changed != 0 || p.requested || (p.reads >= 0 && passes[p.reads].ran);
+    p.requested = false;
+    return p.ran;
+}
+
+bool RenderGraph::idle() const {
+    for (const Pass& p : passes) {
+        if (p.pending != 0 || p.requested) return false;
+    }
+    return true;
+}
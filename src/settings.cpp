@@ -5,6 +5,8 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
 #include "imgui.h"
 #include "settings.h"
 #include "shader.h"
@@ -43,10 +45,14 @@ void save_state(App& app, const std::filesystem::path& path) {
 void update_camera(App& app) {
     GLFWwindow* window = app.window;
     AppState& state = app.state;
-    if (is_pressed(window, GLFW_KEY_W)) state.camera_y += state.pan_speed / state.zoom, state.mark_dirty();
-    if (is_pressed(window, GLFW_KEY_A)) state.camera_x -= state.pan_speed / state.zoom, state.mark_dirty();
-    if (is_pressed(window, GLFW_KEY_S)) state.camera_y -= state.pan_speed / state.zoom, state.mark_dirty();
-    if (is_pressed(window, GLFW_KEY_D)) state.camera_x += state.pan_speed / state.zoom, state.mark_dirty();
+    // pans move by whole window pixels (so whole escape-buffer pixels too),
+    // which lets the renderer shift the old image instead of redrawing it
+    FloatExp pixel = 2.0 / (state.zoom * (double)state.height);
+    FloatExp step = pixel * std::max(1.0, std::round(state.pan_speed * state.height / 2.0));
+    if (is_pressed(window, GLFW_KEY_W)) pan_camera(state, 0.0, step);
+    if (is_pressed(window, GLFW_KEY_A)) pan_camera(state, -step, 0.0);
+    if (is_pressed(window, GLFW_KEY_S)) pan_camera(state, 0.0, -step);
+    if (is_pressed(window, GLFW_KEY_D)) pan_camera(state, step, 0.0);
     if (state.auto_zoom_out || is_pressed(window, GLFW_KEY_Q)) state.zoom /= state.zoom_speed, state.mark_dirty();
     if (state.auto_zoom_in || is_pressed(window, GLFW_KEY_E)) state.zoom *= state.zoom_speed, state.mark_dirty();
 
@@ -54,32 +60,193 @@ void update_camera(App& app) {
         double mouse_x, mouse_y;
         glfwGetCursorPos(window, &mouse_x, &mouse_y);
         
-        double dx = (mouse_x - state.last_mouse_x) * 2.0 / state.width;
-        double dy = (mouse_y - state.last_mouse_y) * 2.0 / state.height;
+        // fractional cursor positions (hi-dpi) carry over to the next frame
+        double dx = std::round(mouse_x - state.last_mouse_x);
+        double dy = std::round(mouse_y - state.last_mouse_y);
 
         if (dx != 0.0 || dy != 0.0) {
-            double aspect = (double)state.width / (double)state.height;
-            state.camera_x -= dx * aspect * 1.0/state.zoom;
-            state.camera_y += dy * 1.0/state.zoom;
-            
-            state.last_mouse_x = mouse_x;
-            state.last_mouse_y = mouse_y;
-    
-            state.mark_dirty();
+            pan_camera(state, -dx * pixel, dy * pixel);
+
+            state.last_mouse_x += dx;
+            state.last_mouse_y += dy;
         }
     }
 }
 
+// moves the camera by a (small) delta without losing the digits that deep
+// zooms rely on
+void pan_camera(AppState& state, const FloatExp& dx, const FloatExp& dy) {
+    int limbs = std::max(state.center_x.frac_limbs(), frac_limbs_for_zoom(state.zoom));
+    state.center_x += BigFixed(dx, limbs);
+    state.center_y += BigFixed(dy, limbs);
+    state.camera_x = state.center_x.to_double();
+    state.camera_y = state.center_y.to_double();
+    state.mark_dirty();
+}
+
+void set_camera(AppState& state, double x, double y) {
+    int limbs = frac_limbs_for_zoom(state.zoom);
+    state.center_x = BigFixed(x, limbs);
+    state.center_y = BigFixed(y, limbs);
+    state.camera_x = x;
+    state.camera_y = y;
+    state.mark_dirty();
+}
+
+bool use_perturbation(const AppState& state) {
+    if (state.deep_zoom) return true;
+    // the cpu can brute-force in quad-double well past where the shader's doubles give out
+    if (state.use_cpu) return !numeric_resolves(Numeric::QuadDouble, state.zoom.to_double(), supersampled_height(state));
+    return state.zoom > DEEP_ZOOM_THRESHOLD;
+}
+
+bool pixel_shift(const AppState& state, const EscapeBufferView& from, int width, int height, int& dx, int& dy) {
+    if (!from.valid || from.width != width || from.height != height || from.iterations != state.max_iterations ||
+        from.zoom != state.zoom) {
+        return false;
+    }
+    FloatExp pixels_per_unit = state.zoom * (height / 2.0);
+    double fx = ((state.center_x - from.center_x).to_floatexp() * pixels_per_unit).to_double();
+    double fy = ((state.center_y - from.center_y).to_floatexp() * pixels_per_unit).to_double();
+    dx = (int)std::lround(fx);
+    dy = (int)std::lround(fy);
+    // anything else changed (settings, sub-pixel moves) needs a full render
+    if (std::fabs(fx - dx) > 1e-3 || std::fabs(fy - dy) > 1e-3 || (dx == 0 && dy == 0)) return false;
+    return std::abs(dx) < width && std::abs(dy) < height;
+}
+
+// past this zoom ratio a preview is mostly missing or blurry, a fresh
+// progressive render looks better
+static constexpr double MAX_REPROJECT_RATIO = 4.0;
+
+bool reprojection(const AppState& state, const EscapeBufferView& from, int width, int height, float transform[4]) {
+    if (!from.valid || from.width != width || from.height != height || from.iterations != state.max_iterations) return false;
+    double ratio = (from.zoom / state.zoom).to_double();
+    if (ratio > MAX_REPROJECT_RATIO || ratio < 1.0 / MAX_REPROJECT_RATIO) return false;
+    // pos = (x - camera) * zoom / aspect horizontally, (y - camera) * zoom vertically
+    double aspect = (double)state.width / (double)state.height;
+    double offset_x = ((state.center_x - from.center_x).to_floatexp() * from.zoom).to_double() / aspect;
+    double offset_y = ((state.center_y - from.center_y).to_floatexp() * from.zoom).to_double();
+    // the new view has to overlap the old one
+    if (std::fabs(offset_x) > 1.0 + ratio || std::fabs(offset_y) > 1.0 + ratio) return false;
+    transform[0] = transform[1] = (float)ratio;
+    transform[2] = (float)offset_x;
+    transform[3] = (float)offset_y;
+    return true;
+}
+
+int supersampled_height(const AppState& state) {
+    return state.antialias ? state.height * 2 : state.height;
+}
+
+// float-float loses a few bits to the gpu's non-IEEE rounding
+static constexpr int FLOAT_FLOAT_BITS = 44;
+
+// Same pixel-footprint rule as the cpu's select_numeric(), so the switch
+// happens while both variants still resolve every pixel.
+ShaderPrecision shader_precision(const AppState& state) {
+    double zoom = state.zoom.to_double();
+    int height = supersampled_height(state);
+    if (numeric_resolves(Numeric::Float, zoom, height)) return ShaderPrecision::Float;
+    if (mantissa_resolves(FLOAT_FLOAT_BITS, zoom, height)) return ShaderPrecision::FloatFloat;
+    return ShaderPrecision::Double;
+}
+
+const char* shader_precision_name(ShaderPrecision precision) {
+    switch (precision) {
+        case ShaderPrecision::Float: return "float";
+        case ShaderPrecision::FloatFloat: return "float-float";
+        default: return "double";
+    }
+}
+
 void update_uniforms(App& app, ShaderProgram& sp) {
     GLFWwindow* window = app.window;
     AppState& state = app.state;
     glUniform1f(sp.uniform_location("time"), glfwGetTime());
     glUniform2d(sp.uniform_location("camera"), state.camera_x, state.camera_y);
-    glUniform1d(sp.uniform_location("zoom"), state.zoom);
+    glUniform1d(sp.uniform_location("zoom"), state.zoom.to_double());
+    // float variants: camera split into hi + lo floats
+    float hi_x = (float)state.camera_x, hi_y = (float)state.camera_y;
+    glUniform2f(sp.uniform_location("camera_hi"), hi_x, hi_y);
+    glUniform2f(sp.uniform_location("camera_lo"), (float)(state.camera_x - hi_x), (float)(state.camera_y - hi_y));
+    double scale_x = 1.0 / state.zoom.to_double() * ((double)state.width / (double)state.height);
+    double scale_y = 1.0 / state.zoom.to_double();
+    float sx = (float)scale_x, sy = (float)scale_y;
+    glUniform4f(sp.uniform_location("pixel_scale"), sx, (float)(scale_x - sx), sy, (float)(scale_y - sy));
     glUniform2f(sp.uniform_location("resolution"), state.width, state.height);
     glUniform1i(sp.uniform_location("iterations"), state.max_iterations);
 }
 
+// covers both perturbation shaders; uniforms a variant doesn't have are ignored
+void update_perturbation_uniforms(App& app, ShaderProgram& sp, const ReferenceOrbit& ref) {
+    AppState& state = app.state;
+    DeepView view = deep_view(state, ref);
+    glUniform2d(sp.uniform_location("offset"), view.offset_x.to_double(), view.offset_y.to_double());
+    glUniform1d(sp.uniform_location("zoom"), view.zoom.to_double());
+    FloatExp scale = FloatExp(1.0) / view.zoom;
+    glUniform2f(sp.uniform_location("offset_m"), (float)view.offset_x.m, (float)view.offset_y.m);
+    glUniform2i(sp.uniform_location("offset_e"), view.offset_x.e, view.offset_y.e);
+    glUniform1f(sp.uniform_location("scale_m"), (float)scale.m);
+    glUniform1i(sp.uniform_location("scale_e"), scale.e);
+    glUniform2f(sp.uniform_location("resolution"), state.width, state.height);
+    glUniform1i(sp.uniform_location("iterations"), state.max_iterations);
+    glUniform1i(sp.uniform_location("ref_length"), ref.length());
+}
+
+// Progressive level `step` renders pixels (i*step, j*step) of a width x height
+// image into a ceil(width/step) x ceil(height/step) target, so every coarser
+// level is a subset of the finer ones. The fractal shaders copy some texels
+// from the texture on unit 0 (`coarser`) instead of iterating them: with
+// `refine` the ones with even coordinates, which the next coarser level
+// already holds; with `reproject` every texel of the reprojected image that
+// isn't marked missing.
+void update_level_uniforms(ShaderProgram& sp, int step, int width, int height, bool refine, bool reproject) {
+    int level_width = (width + step - 1) / step;
+    int level_height = (height + step - 1) / step;
+    // moves the target's fragment centers onto those full-resolution pixel centers
+    double scale_x = (double)level_width * step / width;
+    double scale_y = (double)level_height * step / height;
+    glUniform4f(sp.uniform_location("level_transform"), scale_x - 1.0, scale_y - 1.0,
+                scale_x - 1.0 + (1.0 - step) / width, scale_y - 1.0 + (1.0 - step) / height);
+    glUniform1i(sp.uniform_location("refine"), refine);
+    glUniform1i(sp.uniform_location("reproject"), reproject);
+    glUniform1i(sp.uniform_location("coarser"), 0);
+}
+
+void update_jitter_uniforms(ShaderProgram& sp, double dx, double dy, int width, int height) {
+    glUniform4f(sp.uniform_location("level_transform"), 0.0f, 0.0f, 2.0 * dx / width, 2.0 * dy / height);
+    glUniform1i(sp.uniform_location("refine"), false);
+    glUniform1i(sp.uniform_location("reproject"), false);
+}
+
+// same camera the fractal shader gets from update_uniforms()
+EscapeView escape_view(const AppState& state) {
+    EscapeView view;
+    double parts[4];
+    state.center_x.to_expansion(parts, 4);
+    view.camera_x = parts[0];
+    std::copy(parts + 1, parts + 4, view.camera_x_tail);
+    state.center_y.to_expansion(parts, 4);
+    view.camera_y = parts[0];
+    std::copy(parts + 1, parts + 4, view.camera_y_tail);
+    view.zoom = state.zoom.to_double();
+    view.numeric = state.cpu_numeric;
+    view.aspect = (double)state.width / (double)state.height;
+    view.max_iterations = state.max_iterations;
+    return view;
+}
+
+DeepView deep_view(const AppState& state, const ReferenceOrbit& ref) {
+    DeepView view;
+    view.offset_x = (state.center_x - ref.center_x).to_floatexp();
+    view.offset_y = (state.center_y - ref.center_y).to_floatexp();
+    view.zoom = state.zoom;
+    view.aspect = (double)state.width / (double)state.height;
+    view.max_iterations = state.max_iterations;
+    return view;
+}
+
 bool is_pressed(GLFWwindow* window, int key) {
     return glfwGetKey(window, key) != GLFW_RELEASE;
 }
@@ -126,14 +293,10 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     double fractal_mouse_x = ((mouse_x / state.width) * 2.0 - 1.0) * aspect;
     double fractal_mouse_y = 1.0 - (mouse_y / state.height) * 2.0;
 
-    double fractal_target_x = state.camera_x + fractal_mouse_x / state.zoom;
-    double fractal_target_y = state.camera_y + fractal_mouse_y / state.zoom;
-
+    // keep the point under the cursor fixed: camera + m/zoom == camera' + m/zoom'
+    FloatExp shift = (1.0 - 1.0/zoom_factor) / state.zoom;
     state.zoom *= zoom_factor;
-
-    state.camera_x = fractal_target_x - fractal_mouse_x / state.zoom;
-    state.camera_y = fractal_target_y - fractal_mouse_y / state.zoom;
-    state.mark_dirty();
+    pan_camera(state, fractal_mouse_x * shift, fractal_mouse_y * shift);
 }
 
 void imgui_camera_ui(App& app) {
@@ -143,11 +306,23 @@ void imgui_camera_ui(App& app) {
     // ImGui::PushItemWidth(160); // with arrows
     ImGui::PushItemWidth(120);
     ImGui::AlignTextToFramePadding(); ImGui::Text("x=   "); ImGui::SameLine();
-    if (ImGui::InputDouble("##cam_x", &state.camera_x, 0.0, 0.0, "%15.12f")) state.mark_dirty();
+    if (ImGui::InputDouble("##cam_x", &state.camera_x, 0.0, 0.0, "%15.12f")) {
+        state.center_x = BigFixed(state.camera_x, frac_limbs_for_zoom(state.zoom));
+        state.mark_dirty();
+    }
     ImGui::AlignTextToFramePadding(); ImGui::Text("y=   "); ImGui::SameLine();
-    if (ImGui::InputDouble("##cam_y", &state.camera_y, 0.0, 0.0, "%15.12f")) state.mark_dirty();
+    if (ImGui::InputDouble("##cam_y", &state.camera_y, 0.0, 0.0, "%15.12f")) {
+        state.center_y = BigFixed(state.camera_y, frac_limbs_for_zoom(state.zoom));
+        state.mark_dirty();
+    }
     ImGui::AlignTextToFramePadding(); ImGui::Text("zoom="); ImGui::SameLine();
-    if (ImGui::InputDouble("##zoom", &state.zoom, 0.0, 0.0, "%15.12f")) state.mark_dirty();
+    // text, since the zoom can be far outside double range
+    char zoom_buf[64];
+    std::snprintf(zoom_buf, sizeof zoom_buf, "%s", state.zoom.to_string(9).c_str());
+    if (ImGui::InputText("##zoom", zoom_buf, sizeof zoom_buf, ImGuiInputTextFlags_EnterReturnsTrue)) {
+        FloatExp zoom;
+        if (FloatExp::parse(zoom_buf, zoom) && zoom > 0.0) state.zoom = zoom, state.mark_dirty();
+    }
 
     ImGui::AlignTextToFramePadding();
     ImGui::Text("Auto zoom"); ImGui::SameLine();
@@ -155,11 +330,15 @@ void imgui_camera_ui(App& app) {
     ImGui::SameLine();
     if (ImGui::Checkbox("Out", &state.auto_zoom_out)) state.auto_zoom_in = false;
 
+    if (ImGui::Checkbox("Deep zoom", &state.deep_zoom)) state.mark_dirty();
+    if (!state.deep_zoom && use_perturbation(state)) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(automatic past %.0e)", DEEP_ZOOM_THRESHOLD);
+    }
+
     if (ImGui::Button("Reset")) {
-        state.camera_x = -0.65f;
-        state.camera_y = 0.0f;
-        state.zoom = 0.5f;
+        state.zoom = 0.5;
+        set_camera(state, -0.65, 0.0);
         state.auto_zoom_in = state.auto_zoom_out = false;
-        state.mark_dirty();
     }
 }
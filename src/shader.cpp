@@ -1,38 +1,220 @@
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 // #include <sstream>
-// #include <fstream>
+
+// KHR_parallel_shader_compile isn't in our glad
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static std::filesystem::path cache_dir;
+
+// cache files: this header, then the driver's binary
+struct BinaryHeader {
+    char magic[8];
+    GLenum format;
+    GLint size;
+    unsigned long long key;
+};
+static const char BINARY_MAGIC[8] = {'M', 'A', 'N', 'D', 'S', 'H', 'D', '\0'};
+
+static unsigned long long fnv1a(unsigned long long h, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+// with the terminator, so "ab" + "c" and "a" + "bc" differ
+static unsigned long long fnv1a(unsigned long long h, const char* s) { return s ? fnv1a(h, s, std::strlen(s) + 1) : h; }
+
+// lets the driver compile on as many threads as it likes, once per process
+static void enable_parallel_compile() {
+    static bool done = false;
+    if (done) return;
+    done = true;
+    const char* extensions[] = {"GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile"};
+    const char* functions[] = {"glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"};
+    for (int i = 0; i < 2; i++) {
+        if (!glfwExtensionSupported(extensions[i])) continue;
+        auto max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress(functions[i]);
+        if (max_threads) {
+            max_threads(0xFFFFFFFFu);
+            return;
+        }
+    }
+}
+
+static std::filesystem::path cache_path(unsigned long long key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", key);
+    return cache_dir / name;
+}
+
+void ShaderProgram::set_binary_cache(const std::filesystem::path& dir) { cache_dir = dir; }
 
 ShaderProgram::ShaderProgram() : id(glCreateProgram()) {}
 
-ShaderProgram::~ShaderProgram() { glDeleteProgram(id); }
+ShaderProgram::~ShaderProgram() {
+    for (Stage& s : stages) {
+        if (s.shader) glDeleteShader(s.shader);
+    }
+    glDeleteProgram(id);
+}
 
 bool ShaderProgram::attach_from_string(GLenum shader_type, const char* source) {
-    GLuint shader = glCreateShader(shader_type);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
+    if (!source) return false;
+    stages.push_back({shader_type, source});
+    return true;
+}
 
+void ShaderProgram::link() {
+    started = true;
+    enable_parallel_compile();
+    if (!cache_dir.empty()) {
+        key = 0xcbf29ce484222325ull;
+        // a driver update or another gpu gets its own entries
+        for (GLenum s : {GL_VENDOR, GL_RENDERER, GL_VERSION}) key = fnv1a(key, (const char*)glGetString(s));
+        for (const Stage& s : stages) {
+            key = fnv1a(key, &s.type, sizeof(s.type));
+            key = fnv1a(key, s.source.c_str());
+        }
+        std::ifstream f(cache_path(key), std::ios::binary);
+        BinaryHeader header;
+        if (f.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0 && header.key == key && header.size > 0) {
+            std::vector<char> binary(header.size);
+            if (f.read(binary.data(), header.size)) {
+                glProgramBinary(id, header.format, binary.data(), header.size);
+                GLint status = 0;
+                glGetProgramiv(id, GL_LINK_STATUS, &status);
+                if (status) {
+                    from_cache = true;
+                    return;
+                }
+                // the driver may turn down binaries of an older version, compile then
+            }
+        }
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    // nothing here waits for the compiler, linked() does
+    for (Stage& s : stages) {
+        s.shader = glCreateShader(s.type);
+        const char* source = s.source.c_str();
+        glShaderSource(s.shader, 1, &source, nullptr);
+        glCompileShader(s.shader);
+        glAttachShader(id, s.shader);
+    }
+    glLinkProgram(id);
+}
+
+bool ShaderProgram::compile_log(const Stage& stage) {
     GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cerr << "Compiling " << (shader_type == GL_VERTEX_SHADER ? "vertex shader " : "fragment shader ") << "failed\n" << infoLog << std::endl;
-        return false;
+    glGetShaderiv(stage.shader, GL_COMPILE_STATUS, &success);
+    if (success) return true;
+    GLint length = 0;
+    glGetShaderiv(stage.shader, GL_INFO_LOG_LENGTH, &length);
+    std::vector<char> log(std::max(length, 1));
+    glGetShaderInfoLog(stage.shader, (GLsizei)log.size(), nullptr, log.data());
+    const char* kind = stage.type == GL_VERTEX_SHADER ? "vertex shader " : stage.type == GL_COMPUTE_SHADER ? "compute shader " : "fragment shader ";
+    std::cerr << "Compiling " << kind << "failed\n" << log.data() << std::endl;
+    return false;
+}
+
+bool ShaderProgram::linked() {
+    if (finished) return ok;
+    if (!started) link();
+    finished = true;
+    GLint status = 0;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    ok = status;
+    if (!from_cache) {
+        bool compiled = true;
+        for (const Stage& s : stages) compiled = compile_log(s) && compiled;
+        // a stage that didn't compile already said why
+        if (compiled && !ok) {
+            GLint length = 0;
+            glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+            std::vector<char> log(std::max(length, 1));
+            glGetProgramInfoLog(id, (GLsizei)log.size(), nullptr, log.data());
+            std::cerr << "Linking shader program failed\n" << log.data() << std::endl;
+        }
+        for (Stage& s : stages) {
+            glDetachShader(id, s.shader);
+            glDeleteShader(s.shader);
+            s.shader = 0;
+        }
+        if (ok) store_binary();
     }
+    stages.clear();
+    if (ok) load_uniforms();
+    return ok;
+}
 
-    glAttachShader(id, shader);
-    glDeleteShader(shader);
+void ShaderProgram::store_binary() {
+    if (cache_dir.empty()) return;
+    GLint formats = 0, size = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (formats == 0 || size <= 0) return; // the driver doesn't hand them out
+    std::vector<char> binary(size);
+    BinaryHeader header;
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    glGetProgramBinary(id, size, &header.size, &header.format, binary.data());
+    header.key = key;
 
-    return shader;
+    std::filesystem::path path = cache_path(key), temp = path;
+    temp += ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    {
+        std::ofstream f(temp, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        f.write(binary.data(), header.size);
+        if (!f) {
+            std::cerr << "Failed to write shader cache: " << temp << std::endl;
+            return;
+        }
+    }
+    // renamed into place, another instance never reads half a file
+    std::filesystem::rename(temp, path, ec);
 }
 
-void ShaderProgram::link() { glLinkProgram(id); }
-void ShaderProgram::use() { glUseProgram(id); }
+void ShaderProgram::load_uniforms() {
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> name(max_length + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+        std::string n(name.data(), length);
+        GLint location = glGetUniformLocation(id, n.c_str());
+        if (location < 0) continue; // in a uniform block
+        uniforms[n] = location;
+        // arrays are listed as "name[0]", glGetUniformLocation takes both
+        if (n.size() > 3 && n.compare(n.size() - 3, 3, "[0]") == 0) uniforms[n.substr(0, n.size() - 3)] = location;
+    }
+}
 
-GLint ShaderProgram::uniform_location(const GLchar *name) { return glGetUniformLocation(id, name); }
+void ShaderProgram::use() {
+    if (!finished) linked();
+    glUseProgram(id);
+}
+
+GLint ShaderProgram::uniform_location(const GLchar *name) {
+    if (!finished) linked();
+    auto it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
+}
 
 // GLuint compile_shader_from_file(GLenum shader_type, const char* filepath) {
 //     std::ifstream file(filepath);
@@ -0,0 +1,33 @@
+const char* aa_edge_pass_shader_str = R"(
+
+#version 460 core
+
+// Marks the pixels adaptive_aa.cpp gives extra samples: those whose color,
+// set membership or smooth escape count differs from a 4-neighbour's.
+
+uniform sampler2D escape;
+uniform sampler2D colors; // the palette pass of the same image
+uniform int iterations;
+uniform float threshold;          // per color channel
+uniform float gradient_threshold; // in iterations
+
+layout(location = 0) out float edge;
+
+bool differs(ivec2 a, ivec2 b) {
+    float ea = texelFetch(escape, a, 0).r, eb = texelFetch(escape, b, 0).r;
+    bool inside_a = ea >= float(iterations + 1), inside_b = eb >= float(iterations + 1);
+    if (inside_a != inside_b) return true;
+    if (!inside_a && abs(ea - eb) > gradient_threshold) return true;
+    vec3 d = abs(texelFetch(colors, a, 0).rgb - texelFetch(colors, b, 0).rgb);
+    return max(d.r, max(d.g, d.b)) > threshold;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(escape, 0) - 1;
+    edge = differs(texel, max(texel - ivec2(1, 0), ivec2(0))) || differs(texel, min(texel + ivec2(1, 0), last)) ||
+           differs(texel, max(texel - ivec2(0, 1), ivec2(0))) || differs(texel, min(texel + ivec2(0, 1), last))
+           ? 1.0 : 0.0;
+}
+
+)";
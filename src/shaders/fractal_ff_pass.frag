@@ -0,0 +1,107 @@
+const char* fractal_ff_pass_fragment_str = R"(
+
+#version 460 core
+in vec2 pos;
+
+// fractal_pass.frag in "float-float": every real is an unevaluated sum hi + lo
+// of two floats (~44 usable bits), stored as vec2(hi, lo). Several times the
+// float cost, but still far cheaper than native double on consumer GPUs.
+// `precise` keeps the compiler from reassociating away the error terms.
+
+uniform vec2 camera_hi;
+uniform vec2 camera_lo;
+uniform vec4 pixel_scale; // 1/zoom * (aspect, 1) as float-float: (x hi, x lo, y hi, y lo)
+
+uniform int iterations;
+
+// texels copied from `coarser` instead of iterated, see update_level_uniforms()
+uniform bool refine;
+uniform bool reproject;
+uniform sampler2D coarser; // coarser level or reprojected image
+// adaptive antialiasing sample list, see AdaptiveAA::render_samples()
+uniform bool sample_list;
+uniform sampler2D sample_pos;
+
+layout(location = 0) out float escapeIter;
+
+vec2 ff_add(vec2 a, vec2 b) {
+    precise float s = a.x + b.x;
+    precise float v = s - a.x;
+    precise float e = (a.x - (s - v)) + (b.x - v) + (a.y + b.y);
+    precise float hi = s + e;
+    return vec2(hi, e - (hi - s));
+}
+
+vec2 ff_sub(vec2 a, vec2 b) {
+    return ff_add(a, -b);
+}
+
+vec2 ff_mul(vec2 a, vec2 b) {
+    precise float p = a.x * b.x;
+    precise float e = fma(a.x, b.x, -p) + (a.x * b.y + a.y * b.x);
+    precise float hi = p + e;
+    return vec2(hi, e - (hi - p));
+}
+
+// main cardioid or period-2 bulb: never escapes. On the high parts, the
+// same test as fractal_float_pass.frag
+bool in_main_bulbs(vec2 c) {
+    float y2 = c.y * c.y;
+    float q = (c.x - 0.25) * (c.x - 0.25) + y2;
+    if (q * (q + (c.x - 0.25)) <= 0.25 * y2) return true;
+    return (c.x + 1.0) * (c.x + 1.0) + y2 <= 0.0625;
+}
+
+float mandel(vec2 cx, vec2 cy) {
+    if (in_main_bulbs(vec2(cx.x, cy.x))) return iterations + 1;
+    // Brent's cycle detection, see fractal_pass.frag. The differences are
+    // taken in float-float, the high parts alone would match too early.
+    float period_eps = 1e-6 * pixel_scale.z;
+    vec2 saved_x = vec2(0.0), saved_y = vec2(0.0);
+    int check = 1;
+    vec2 zx = vec2(0.0), zy = vec2(0.0);
+    for (int i = 1; i <= iterations; i++) {
+        vec2 x2 = ff_mul(zx, zx), y2 = ff_mul(zy, zy), xy = ff_mul(zx, zy);
+        zx = ff_add(ff_sub(x2, y2), cx);
+        zy = ff_add(2.0 * xy, cy); // doubling is exact
+
+        // the high parts are plenty for the bailout
+        float mag_sq = zx.x*zx.x + zy.x*zy.x;
+        if (mag_sq > 4294967296.0) {
+            float log_zn = log(mag_sq) / 2.0;
+            float nu = log(log_zn / log(2.0)) / log(2.0);
+            return i + 1.0 - nu;
+        }
+        float dx = ff_sub(zx, saved_x).x, dy = ff_sub(zy, saved_y).x;
+        if (dx*dx + dy*dy < period_eps*period_eps) break;
+        if (i == check) {
+            saved_x = zx;
+            saved_y = zy;
+            check *= 2;
+        }
+    }
+    return iterations + 1; // no bailout; is in the set
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (refine && texel % 2 == ivec2(0)) {
+        escapeIter = texelFetch(coarser, texel / 2, 0).r;
+        return;
+    }
+    if (reproject) {
+        float previous = texelFetch(coarser, texel, 0).r;
+        if (previous > -1e37) { // see reproject_pass.frag
+            escapeIter = previous;
+            return;
+        }
+    }
+    vec2 p = sample_list ? texelFetch(sample_pos, texel, 0).xy : pos;
+    // offsets rounded like fractal_pass.frag's double math, so switching
+    // variants doesn't shift pixels
+    vec2 cx = ff_add(vec2(camera_hi.x, camera_lo.x), ff_mul(vec2(p.x, 0.0), pixel_scale.xy));
+    vec2 cy = ff_add(vec2(camera_hi.y, camera_lo.y), ff_mul(vec2(p.y, 0.0), pixel_scale.zw));
+    escapeIter = mandel(cx, cy);
+}
+
+)";
@@ -0,0 +1,78 @@
+const char* fractal_float_pass_fragment_str = R"(
+
+#version 460 core
+in vec2 pos;
+
+// fractal_pass.frag in single precision, for shallow zooms where float still
+// resolves a pixel. Consumer GPUs run float at 32-64x the rate of double.
+
+uniform vec2 camera_hi;
+uniform vec4 pixel_scale; // 1/zoom * (aspect, 1), high parts in .x and .z
+
+uniform int iterations;
+
+// texels copied from `coarser` instead of iterated, see update_level_uniforms()
+uniform bool refine;
+uniform bool reproject;
+uniform sampler2D coarser; // coarser level or reprojected image
+// adaptive antialiasing sample list, see AdaptiveAA::render_samples()
+uniform bool sample_list;
+uniform sampler2D sample_pos;
+
+layout(location = 0) out float escapeIter;
+
+vec2 square_complex(vec2 complex) {
+    return vec2(complex.x * complex.x - complex.y * complex.y, 2.0 * complex.x * complex.y);
+}
+
+// main cardioid or period-2 bulb: never escapes
+bool in_main_bulbs(vec2 c) {
+    float y2 = c.y * c.y;
+    float q = (c.x - 0.25) * (c.x - 0.25) + y2;
+    if (q * (q + (c.x - 0.25)) <= 0.25 * y2) return true;
+    return (c.x + 1.0) * (c.x + 1.0) + y2 <= 0.0625;
+}
+
+float mandel(vec2 z, vec2 c) {
+    if (in_main_bulbs(c)) return iterations + 1;
+    // Brent's cycle detection, see fractal_pass.frag
+    float period_eps = 1e-6 * pixel_scale.z;
+    vec2 saved = z;
+    int check = 1;
+    for (int i = 1; i <= iterations; i++) {
+        z = square_complex(z) + c;
+
+        if (length(z) > (1<<16)) {
+            float log_zn = log(z.x*z.x + z.y*z.y) / 2.0;
+            float nu = log(log_zn / log(2.0)) / log(2.0);
+            return i + 1.0 - nu;
+        }
+        vec2 d = z - saved;
+        if (dot(d, d) < period_eps*period_eps) break;
+        if (i == check) {
+            saved = z;
+            check *= 2;
+        }
+    }
+    return iterations + 1; // no bailout; is in the set
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (refine && texel % 2 == ivec2(0)) {
+        escapeIter = texelFetch(coarser, texel / 2, 0).r;
+        return;
+    }
+    if (reproject) {
+        float previous = texelFetch(coarser, texel, 0).r;
+        if (previous > -1e37) { // see reproject_pass.frag
+            escapeIter = previous;
+            return;
+        }
+    }
+    vec2 p = sample_list ? texelFetch(sample_pos, texel, 0).xy : pos;
+    vec2 coords = camera_hi + p * pixel_scale.xz;
+    escapeIter = mandel(vec2(0.0, 0.0), coords);
+}
+
+)";
@@ -10,6 +10,14 @@ uniform double zoom;
 
 uniform int iterations;
 
+// texels copied from `coarser` instead of iterated, see update_level_uniforms()
+uniform bool refine;
+uniform bool reproject;
+uniform sampler2D coarser; // coarser level or reprojected image
+// adaptive antialiasing sample list, see AdaptiveAA::render_samples()
+uniform bool sample_list;
+uniform sampler2D sample_pos;
+
 // out vec4 FragColor;
 layout(location = 0) out float escapeIter;
 
@@ -26,9 +34,24 @@ dvec2 square_complex(dvec2 complex) {
     return res;
 }
 
+// main cardioid or period-2 bulb: never escapes
+bool in_main_bulbs(dvec2 c) {
+    double y2 = c.y * c.y;
+    double q = (c.x - 0.25) * (c.x - 0.25) + y2;
+    if (q * (q + (c.x - 0.25)) <= 0.25 * y2) return true;
+    return (c.x + 1.0) * (c.x + 1.0) + y2 <= 0.0625;
+}
+
 // returns # iterations to reach escape condition
 // for mandelbrot, the parameter z should be (0,0).
 float mandel(dvec2 z, dvec2 c) {
+    if (in_main_bulbs(c)) return iterations + 1;
+    // Brent's cycle detection: z is compared against the orbit point saved
+    // at the last power of two, a repeat means the orbit is periodic (interior).
+    // epsilon is far below a pixel, so only true cycles are caught.
+    double period_eps = 1e-6 / zoom;
+    dvec2 saved = z;
+    int check = 1;
     for (int i = 1; i <= iterations; i++) {
         z = square_complex(z) + c;
 
@@ -37,15 +60,34 @@ float mandel(dvec2 z, dvec2 c) {
             float nu = log(log_zn / log(2.0)) / log(2.0);
             return i + 1.0 - nu;
         }
+        dvec2 d = z - saved;
+        if (d.x*d.x + d.y*d.y < period_eps*period_eps) break;
+        if (i == check) {
+            saved = z;
+            check *= 2;
+        }
     }
     return iterations + 1; // no bailout; is in the set
 }
 
 void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (refine && texel % 2 == ivec2(0)) {
+        escapeIter = texelFetch(coarser, texel / 2, 0).r;
+        return;
+    }
+    if (reproject) {
+        float previous = texelFetch(coarser, texel, 0).r;
+        if (previous > -1e37) { // see reproject_pass.frag
+            escapeIter = previous;
+            return;
+        }
+    }
+    vec2 p = sample_list ? texelFetch(sample_pos, texel, 0).xy : pos;
     double aspect = double(resolution.x) / double(resolution.y);
     dvec2 coords = camera + dvec2(
-        pos.x * 1.0/zoom * aspect, 
-        pos.y * 1.0/zoom
+        p.x * 1.0/zoom * aspect, 
+        p.y * 1.0/zoom
     );
     // mandel returns 1 ~ iterations+1
     escapeIter = mandel(dvec2(0.0,0.0), coords);
@@ -0,0 +1,48 @@
+const char* mariani_silver_decide_pass_shader_str = R"(
+
+#version 460 core
+
+// One fragment per block: scans the block's border rings (all iterated by
+// now) and outputs the value to fill its inside with, or PENDING if they
+// don't agree and the block has to be split further.
+
+uniform sampler2D escape;
+uniform int block;
+uniform int guard;
+uniform int iterations;
+uniform bool integer_bands; // smooth coloring off, see cpu_render_mariani_silver()
+
+layout(location = 0) out float fill;
+
+const float PENDING = -1e36;
+
+// escape values that color the same; -2 never matches
+float band(float v) {
+    if (v >= float(iterations + 1)) return -1.0;
+    return integer_bands ? floor(v - 0.5) : -2.0;
+}
+
+void main() {
+    ivec2 size = textureSize(escape, 0);
+    ivec2 lo = ivec2(gl_FragCoord.xy) * block;
+    ivec2 hi = min(lo + block, size - 1);
+    fill = PENDING;
+    if (any(lessThanEqual(hi - lo, ivec2(2 * guard + 1)))) return; // no inside
+
+    float first = texelFetch(escape, lo, 0).r;
+    float b = band(first);
+    if (b == -2.0) return;
+    for (int i = 0; i <= guard; i++) {
+        for (int x = lo.x; x <= hi.x; x++) {
+            if (band(texelFetch(escape, ivec2(x, lo.y + i), 0).r) != b) return;
+            if (band(texelFetch(escape, ivec2(x, hi.y - i), 0).r) != b) return;
+        }
+        for (int y = lo.y; y <= hi.y; y++) {
+            if (band(texelFetch(escape, ivec2(lo.x + i, y), 0).r) != b) return;
+            if (band(texelFetch(escape, ivec2(hi.x - i, y), 0).r) != b) return;
+        }
+    }
+    fill = first;
+}
+
+)";
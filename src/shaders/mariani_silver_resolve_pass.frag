@@ -0,0 +1,47 @@
+const char* mariani_silver_resolve_pass_shader_str = R"(
+
+#version 460 core
+
+// First pass of every Mariani-Silver level (mariani_silver_pass.cpp). Texels
+// still PENDING either take the fill value their block got from the previous
+// level's decide pass, or, if they lie on a block border of this level, turn
+// MISSING so the fractal pass (in `reproject` mode) iterates them.
+
+uniform sampler2D escape;    // PENDING where not known yet
+uniform sampler2D decisions; // one texel per block of the previous level
+uniform int parent_block;    // its block size, 0 on the first level
+uniform int block;           // 0 on the last pass: everything left is iterated
+uniform int guard;
+
+layout(location = 0) out float escapeIter;
+
+const float PENDING = -1e36;
+const float MISSING = -1e38;
+
+// the border is guard + 1 texels thick on both sides of every block edge,
+// and along the image edges
+bool on_border(int p, int size) {
+    int m = p % block;
+    return m <= guard || m >= block - guard || p >= size - 1 - guard;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float value = texelFetch(escape, texel, 0).r;
+    if (value >= 0.0) {
+        escapeIter = value;
+        return;
+    }
+    if (parent_block > 0) {
+        float fill = texelFetch(decisions, texel / parent_block, 0).r;
+        if (fill >= 0.0) {
+            escapeIter = fill;
+            return;
+        }
+    }
+    ivec2 size = textureSize(escape, 0);
+    bool border = block == 0 || on_border(texel.x, size.x) || on_border(texel.y, size.y);
+    escapeIter = border ? MISSING : PENDING;
+}
+
+)";
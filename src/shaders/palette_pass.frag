@@ -6,19 +6,56 @@ in vec2 pos;
 in vec2 tex;
 
 uniform sampler2D iterTex;  // R32F
-uniform sampler1D paletteTex;       // RGB or RGBA
+// Palette::generate(): paletteSize reds, then the greens, then the blues
+uniform samplerBuffer paletteTex;   // R32F
+uniform int paletteSize;
+uniform bool smoothColors;
 uniform int iterations;
 
+// adaptive antialiasing (adaptive_aa.cpp): texels on an edge average their
+// own color with that of `sampleCount` - 1 extra samples from `samples`
+uniform bool antialias;
+uniform sampler2D edgeIndex; // R32F, sample list index or -1
+uniform sampler2D samples;   // R32F, sampleCount - 1 texels per edge, row-major
+uniform int sampleCount;
+
 out vec4 FragColor;
 
 // uniform sampler2D superTexture;
 
+vec3 entry(float i) {
+    // clamped as a float, the int conversion of a huge one is undefined
+    int k = int(clamp(i, 0.0, float(paletteSize - 1)));
+    return vec3(texelFetch(paletteTex, k).r, texelFetch(paletteTex, paletteSize + k).r,
+                texelFetch(paletteTex, 2 * paletteSize + k).r);
+}
+
+// what linear / nearest filtering with clamp-to-edge did on the old 1D
+// texture, and palette_color() does on the cpu
+vec4 color(float iter) {
+    float t = (iter - 0.5) / float(iterations + 1);
+    float u = t * float(paletteSize);
+    if (!smoothColors) return vec4(entry(floor(u)), 1.0);
+    u -= 0.5;
+    float i = floor(u);
+    return vec4(mix(entry(i), entry(i + 1.0), u - i), 1.0);
+}
+
 void main() {
     float iter = texture(iterTex, tex).r;
 
-    float t = (iter - 0.5) / float(iterations + 1);
-    FragColor = texture(paletteTex, t);
-    // vec4 color = texture(paletteTex, t);
+    FragColor = color(iter);
+    if (antialias) {
+        float index = texelFetch(edgeIndex, ivec2(gl_FragCoord.xy), 0).r;
+        if (index >= 0.0) {
+            int width = textureSize(samples, 0).x;
+            int first = int(index) * (sampleCount - 1);
+            for (int k = first; k < first + sampleCount - 1; k++) {
+                FragColor += color(texelFetch(samples, ivec2(k % width, k / width), 0).r);
+            }
+            FragColor /= float(sampleCount);
+        }
+    }
 
     // FragColor = vec4(t, t, t, 1.0); // debug
     // FragColor = vec4(pos.x, pos.y, iter, 1.0); // debug
@@ -0,0 +1,139 @@
+const char* perturbation_floatexp_pass_fragment_str = R"(
+
+#version 460 core
+in vec2 pos;
+
+uniform vec2 resolution;
+// camera minus reference center, and 1/zoom, as mantissa * 2^exponent
+uniform vec2 offset_m;
+uniform ivec2 offset_e;
+uniform float scale_m;
+uniform int scale_e;
+uniform int iterations;
+uniform int ref_length;
+
+// texels copied from `coarser` instead of iterated, see update_level_uniforms()
+uniform bool refine;
+uniform bool reproject;
+uniform sampler2D coarser; // coarser level or reprojected image
+// adaptive antialiasing sample list, see AdaptiveAA::render_samples()
+uniform bool sample_list;
+uniform sampler2D sample_pos;
+
+layout(std430, binding = 0) readonly buffer ReferenceOrbit {
+    dvec2 ref_z[];
+};
+
+layout(location = 0) out float escapeIter;
+
+/*  floatexp: float mantissa in [0.5, 1) plus an int exponent, the GLSL twin
+ *  of FloatExp in floatexp.h. Used for pixel deltas once zoom is past 1e290
+ *  and they would underflow even doubles.
+*/
+struct fexp {
+    float m;
+    int e;
+};
+
+fexp fe(float m, int e) {
+    int k;
+    float n = frexp(m, k);
+    return fexp(n, m == 0.0 ? 0 : e + k);
+}
+
+// split from the double itself, narrowing to float first would lose the
+// low mantissa bits of reference orbit values
+fexp fe_double(double m) {
+    int k;
+    double n = frexp(m, k);
+    return fexp(float(n), m == 0.0 ? 0 : k);
+}
+
+fexp fe_mul(fexp a, fexp b) { return fe(a.m * b.m, a.e + b.e); }
+fexp fe_scale(fexp a, float s) { return fe(a.m * s, a.e); }
+
+fexp fe_add(fexp a, fexp b) {
+    if (a.m == 0.0) return b;
+    if (b.m == 0.0) return a;
+    int d = a.e - b.e;
+    // past 30 bits the smaller term can't change a float mantissa
+    if (d > 30) return a;
+    if (d < -30) return b;
+    return d >= 0 ? fe(a.m + ldexp(b.m, -d), a.e) : fe(ldexp(a.m, d) + b.m, b.e);
+}
+
+fexp fe_sub(fexp a, fexp b) { return fe_add(a, fexp(-b.m, b.e)); }
+
+// 0 below float range (ldexp is undefined out of range)
+float fe_float(fexp a) {
+    if (a.e < -125) return 0.0;
+    return ldexp(a.m, min(a.e, 127));
+}
+
+// 0 below double range
+double fe_to_double(fexp a) {
+    if (a.e < -1021) return double(0.0);
+    return ldexp(double(a.m), a.e);
+}
+
+// same loop as perturbation_pass.frag, with dz and dc in floatexp
+float mandel_perturbed(fexp dc_x, fexp dc_y) {
+    fexp dz_x = fexp(0.0, 0), dz_y = fexp(0.0, 0);
+    int m = 0;
+    for (int i = 1; i <= iterations; i++) {
+        if (m == ref_length - 1) { // reference exhausted: rebase
+            dvec2 z = ref_z[m] + dvec2(fe_to_double(dz_x), fe_to_double(dz_y));
+            dz_x = fe_double(z.x);
+            dz_y = fe_double(z.y);
+            m = 0;
+        }
+        vec2 Z2 = 2.0 * vec2(ref_z[m]);
+        fexp xy = fe_mul(dz_x, dz_y);
+        fexp nx = fe_add(fe_sub(fe_scale(dz_x, Z2.x), fe_scale(dz_y, Z2.y)),
+                         fe_add(fe_sub(fe_mul(dz_x, dz_x), fe_mul(dz_y, dz_y)), dc_x));
+        fexp ny = fe_add(fe_add(fe_scale(dz_y, Z2.x), fe_scale(dz_x, Z2.y)),
+                         fe_add(fe_scale(xy, 2.0), dc_y));
+        dz_x = nx;
+        dz_y = ny;
+        m++;
+
+        vec2 dz = vec2(fe_float(dz_x), fe_float(dz_y));
+        dvec2 z_d = ref_z[m] + dvec2(dz);
+        vec2 z = vec2(z_d);
+        float mag_sq = dot(z, z);
+        if (mag_sq > float(1<<16) * float(1<<16)) {
+            float log_zn = log(mag_sq) / 2.0;
+            float nu = log(log_zn / log(2.0)) / log(2.0);
+            return i + 1.0 - nu;
+        }
+        if (mag_sq < dot(dz, dz)) { // glitch: rebase
+            dz_x = fe_double(z_d.x);
+            dz_y = fe_double(z_d.y);
+            m = 0;
+        }
+    }
+    return iterations + 1;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (refine && texel % 2 == ivec2(0)) {
+        escapeIter = texelFetch(coarser, texel / 2, 0).r;
+        return;
+    }
+    if (reproject) {
+        float previous = texelFetch(coarser, texel, 0).r;
+        if (previous > -1e37) { // see reproject_pass.frag
+            escapeIter = previous;
+            return;
+        }
+    }
+    vec2 p = sample_list ? texelFetch(sample_pos, texel, 0).xy : pos;
+    float aspect = resolution.x / resolution.y;
+    fexp scale = fexp(scale_m, scale_e);
+    fexp dc_x = fe_add(fexp(offset_m.x, offset_e.x), fe_scale(scale, p.x * aspect));
+    fexp dc_y = fe_add(fexp(offset_m.y, offset_e.y), fe_scale(scale, p.y));
+    escapeIter = mandel_perturbed(dc_x, dc_y);
+}
+
+)";
@@ -0,0 +1,89 @@
+const char* perturbation_pass_fragment_str = R"(
+
+#version 460 core
+in vec2 pos;
+
+uniform vec2 resolution;
+uniform dvec2 offset;   // camera minus reference center
+uniform double zoom;
+uniform int iterations;
+uniform int ref_length;
+
+// texels copied from `coarser` instead of iterated, see update_level_uniforms()
+uniform bool refine;
+uniform bool reproject;
+uniform sampler2D coarser; // coarser level or reprojected image
+// adaptive antialiasing sample list, see AdaptiveAA::render_samples()
+uniform bool sample_list;
+uniform sampler2D sample_pos;
+
+// Z_0 .. Z_{ref_length-1}, computed at full precision on the cpu
+layout(std430, binding = 0) readonly buffer ReferenceOrbit {
+    dvec2 ref_z[];
+};
+
+layout(location = 0) out float escapeIter;
+
+dvec2 square_complex(dvec2 complex) {
+    dvec2 res;
+    res.x = (complex.x * complex.x - complex.y * complex.y);
+    res.y = 2 * complex.x * complex.y;
+    return res;
+}
+
+dvec2 mul_complex(dvec2 a, dvec2 b) {
+    return dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// same smooth count as fractal_pass.frag, with pixels iterating only their
+// delta dz from the reference orbit
+float mandel_perturbed(dvec2 dc) {
+    dvec2 dz = dvec2(0.0);
+    int m = 0;
+    for (int i = 1; i <= iterations; i++) {
+        if (m == ref_length - 1) { // reference exhausted: rebase
+            dz += ref_z[m];
+            m = 0;
+        }
+        dz = 2.0 * mul_complex(ref_z[m], dz) + square_complex(dz) + dc;
+        m++;
+
+        dvec2 z = ref_z[m] + dz;
+        double mag_sq = dot(z, z);
+        if (mag_sq > double(1<<16) * double(1<<16)) {
+            float log_zn = log(float(mag_sq)) / 2.0;
+            float nu = log(log_zn / log(2.0)) / log(2.0);
+            return i + 1.0 - nu;
+        }
+        // glitch (z got closer to 0 than to the reference): rebase onto Z_0 = 0
+        if (mag_sq < dot(dz, dz)) {
+            dz = z;
+            m = 0;
+        }
+    }
+    return iterations + 1;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (refine && texel % 2 == ivec2(0)) {
+        escapeIter = texelFetch(coarser, texel / 2, 0).r;
+        return;
+    }
+    if (reproject) {
+        float previous = texelFetch(coarser, texel, 0).r;
+        if (previous > -1e37) { // see reproject_pass.frag
+            escapeIter = previous;
+            return;
+        }
+    }
+    vec2 p = sample_list ? texelFetch(sample_pos, texel, 0).xy : pos;
+    double aspect = double(resolution.x) / double(resolution.y);
+    dvec2 dc = offset + dvec2(
+        p.x * 1.0/zoom * aspect,
+        p.y * 1.0/zoom
+    );
+    escapeIter = mandel_perturbed(dc);
+}
+
+)";
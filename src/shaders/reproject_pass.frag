@@ -0,0 +1,37 @@
+const char* reproject_pass_shader_str = R"(
+
+#version 460 core
+
+// Zoom preview: resamples the previous escape image under the new camera.
+// Texels whose source is outside the old view, plus one texel of every 2x2
+// block (rotating with `phase`), come out as MISSING and get iterated by the
+// fractal pass; the rest are reused. Every texel is thus recomputed at least
+// every 4 frames while zooming, and the last 3 phases finish once it stops.
+
+in vec2 pos;
+
+uniform sampler2D previous;
+uniform vec4 transform; // old pos = pos * transform.xy + transform.zw
+uniform int phase;
+
+layout(location = 0) out float escapeIter;
+
+const float MISSING = -1e38;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if ((texel.x & 1) + 2 * (texel.y & 1) == phase) {
+        escapeIter = MISSING;
+        return;
+    }
+    vec2 old_pos = pos * transform.xy + transform.zw;
+    if (any(greaterThan(abs(old_pos), vec2(1.0)))) {
+        escapeIter = MISSING;
+        return;
+    }
+    ivec2 size = textureSize(previous, 0);
+    ivec2 source = min(ivec2((old_pos * 0.5 + 0.5) * vec2(size)), size - 1);
+    escapeIter = texelFetch(previous, source, 0).r;
+}
+
+)";
@@ -5,9 +5,12 @@ layout (location = 0) in vec2 aPos;
 layout (location = 1) in vec2 aTex;
 out vec2 pos;
 out vec2 tex;
+// (scale - 1, offset) applied to pos for progressive levels, zero = identity.
+// see update_level_uniforms()
+uniform vec4 level_transform;
 void main() {
     gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0);
-    pos = aPos;
+    pos = aPos * (1.0 + level_transform.xy) + level_transform.zw;
     tex = aTex;
 }
 
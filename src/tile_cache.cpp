@@ -0,0 +1,306 @@
+#include "tile_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tile_scheduler.h"
+
+static constexpr char MAGIC[8] = {'M', 'A', 'N', 'D', 'T', 'I', 'L', 'E'};
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t TILE_BYTES = (size_t)TileCache::TILE_SIZE * TileCache::TILE_SIZE * sizeof(float);
+
+struct TileCache::Header {
+    char magic[8];
+    uint32_t version, tile_size, slots, reserved;
+    uint64_t clock; // bumped on every use, for the lru
+};
+
+struct TileCache::Entry {
+    Key key;
+    uint32_t used;
+    uint64_t last_used;
+};
+
+size_t TileCache::KeyHash::operator()(const Key& k) const {
+    uint64_t h = (uint64_t)k.tx * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)k.ty * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= ((uint64_t)k.level << 40) ^ ((uint64_t)k.numeric << 32) ^ (uint32_t)k.iterations;
+    return (size_t)(h ^ (h >> 29));
+}
+
+size_t TileCache::data_offset(int slots) {
+    size_t head = sizeof(Header) + (size_t)slots * 48;
+    return (head + 4095) / 4096 * 4096;
+}
+
+// floor(a / b) for b > 0
+static int64_t floor_div(int64_t a, int64_t b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+TileCache::~TileCache() { close(); }
+
+bool TileCache::open(const std::filesystem::path& path, size_t max_bytes) {
+    close();
+    static_assert(sizeof(Entry) <= 48, "index entries are laid out 48 bytes apart");
+    slots = std::max(1, (int)(max_bytes / TILE_BYTES));
+    size_t size = data_offset(slots) + (size_t)slots * TILE_BYTES;
+    bool fresh = false;
+#ifdef _WIN32
+    HANDLE f = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open tile cache " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER current;
+    GetFileSizeEx(f, &current);
+    if ((size_t)current.QuadPart != size) {
+        fresh = true;
+        LARGE_INTEGER zero{}, want;
+        want.QuadPart = (LONGLONG)size;
+        SetFilePointerEx(f, zero, nullptr, FILE_BEGIN);
+        SetEndOfFile(f);
+        SetFilePointerEx(f, want, nullptr, FILE_BEGIN);
+        SetEndOfFile(f);
+    }
+    HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+    void* view = m ? MapViewOfFile(m, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+    if (!view) {
+        std::cerr << "Failed to map tile cache " << path << std::endl;
+        if (m) CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "Failed to open tile cache " << path << std::endl;
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        return false;
+    }
+    if ((size_t)st.st_size != size) {
+        // sparse, only written slots take disk space
+        fresh = true;
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0) {
+            std::cerr << "Failed to resize tile cache " << path << std::endl;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map tile cache " << path << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+#endif
+    base = (unsigned char*)view;
+    mapped_bytes = size;
+
+    Header* header = (Header*)base;
+    if (fresh || std::memcmp(header->magic, MAGIC, sizeof MAGIC) != 0 || header->version != VERSION ||
+        header->tile_size != TILE_SIZE || header->slots != (uint32_t)slots) {
+        std::memset(base, 0, data_offset(slots));
+        std::memcpy(header->magic, MAGIC, sizeof MAGIC);
+        header->version = VERSION;
+        header->tile_size = TILE_SIZE;
+        header->slots = slots;
+    }
+    for (int s = 0; s < slots; s++) {
+        if (entry(s)->used) index[entry(s)->key] = s;
+    }
+    quit = false;
+    worker = std::thread(&TileCache::worker_loop, this);
+    return true;
+}
+
+void TileCache::close() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            wanted.clear();
+        }
+        wake.notify_all();
+        worker.join();
+    }
+    if (!base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle((HANDLE)mapping);
+    CloseHandle((HANDLE)file);
+    mapping = file = nullptr;
+#else
+    munmap(base, mapped_bytes);
+    ::close(fd);
+    fd = -1;
+#endif
+    base = nullptr;
+    index.clear();
+}
+
+TileCache::Entry* TileCache::entry(int slot) const { return (Entry*)(base + sizeof(Header) + (size_t)slot * 48); }
+float* TileCache::data(int slot) const { return (float*)(base + data_offset(slots) + (size_t)slot * TILE_BYTES); }
+
+bool TileCache::cover(const EscapeView& view, int width, int height, Cover& c) const {
+    if (!(view.zoom > 0.0) || width <= 0 || height <= 0) return false;
+    double pixel = 2.0 / (view.zoom * height);
+    // the coarsest level that is still at least as fine as the pixels
+    c.level = std::max(0, (int)std::ceil(std::log2(4.0 / (TILE_SIZE * pixel)) - 1e-9));
+    if (c.level > MAX_LEVEL) return false;
+    c.spacing = std::ldexp(4.0 / TILE_SIZE, -c.level);
+    double half_x = view.aspect / view.zoom, half_y = 1.0 / view.zoom;
+    auto sample_index = [&](double c0) { return (int64_t)std::floor(c0 / c.spacing); };
+    c.tx0 = floor_div(sample_index(view.camera_x - half_x + half_x / width), TILE_SIZE);
+    c.tx1 = floor_div(sample_index(view.camera_x + half_x - half_x / width), TILE_SIZE);
+    c.ty0 = floor_div(sample_index(view.camera_y - half_y + half_y / height), TILE_SIZE);
+    c.ty1 = floor_div(sample_index(view.camera_y + half_y - half_y / height), TILE_SIZE);
+    if ((c.tx1 - c.tx0 + 1) * (c.ty1 - c.ty0 + 1) > slots) return false;
+
+    Numeric numeric = view.numeric;
+    if (numeric == Numeric::Auto) numeric = select_numeric(2.0 / (TILE_SIZE * c.spacing), TILE_SIZE);
+    c.keys.clear();
+    for (int64_t ty = c.ty0; ty <= c.ty1; ty++) {
+        for (int64_t tx = c.tx0; tx <= c.tx1; tx++) {
+            c.keys.push_back({c.level, view.max_iterations, (int32_t)numeric, tx, ty});
+        }
+    }
+    return true;
+}
+
+bool TileCache::sample(const EscapeView& view, int width, int height, float* out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Cover c;
+    if (!base || !cover(view, width, height, c)) return false;
+    Header* header = (Header*)base;
+    std::vector<const float*> tiles;
+    for (const Key& key : c.keys) {
+        auto it = index.find(key);
+        if (it == index.end()) return false;
+        tiles.push_back(data(it->second));
+    }
+    for (const Key& key : c.keys) entry(index[key])->last_used = ++header->clock;
+
+    // the same pixel centers as the escape kernels, see EscapeView
+    int64_t columns = c.tx1 - c.tx0 + 1;
+    std::vector<int> tile_x(width), sample_x(width);
+    for (int x = 0; x < width; x++) {
+        double cx = view.camera_x + ((2.0 * x + 1.0) / width - 1.0) * view.aspect / view.zoom;
+        int64_t g = (int64_t)std::floor(cx / c.spacing);
+        int64_t t = std::clamp(floor_div(g, TILE_SIZE), c.tx0, c.tx1);
+        tile_x[x] = (int)(t - c.tx0);
+        sample_x[x] = (int)std::clamp<int64_t>(g - t * TILE_SIZE, 0, TILE_SIZE - 1);
+    }
+    for (int y = 0; y < height; y++) {
+        double cy = view.camera_y + ((2.0 * y + 1.0) / height - 1.0) / view.zoom;
+        int64_t g = (int64_t)std::floor(cy / c.spacing);
+        int64_t t = std::clamp(floor_div(g, TILE_SIZE), c.ty0, c.ty1);
+        int j = (int)std::clamp<int64_t>(g - t * TILE_SIZE, 0, TILE_SIZE - 1);
+        const float* const* row = tiles.data() + (t - c.ty0) * columns;
+        float* dst = out + (size_t)y * width;
+        for (int x = 0; x < width; x++) dst[x] = row[tile_x[x]][(size_t)j * TILE_SIZE + sample_x[x]];
+    }
+    return true;
+}
+
+void TileCache::prefetch(const EscapeView& view, int width, int height) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Cover c;
+        wanted.clear();
+        if (!base || !cover(view, width, height, c)) return;
+        for (const Key& key : c.keys) {
+            if (!index.count(key)) wanted.push_back({key, view});
+        }
+        // the middle of the view first
+        double mx = (c.tx0 + c.tx1) * 0.5, my = (c.ty0 + c.ty1) * 0.5;
+        std::sort(wanted.begin(), wanted.end(), [&](const auto& a, const auto& b) {
+            return std::hypot(a.first.tx - mx, a.first.ty - my) > std::hypot(b.first.tx - mx, b.first.ty - my);
+        });
+    }
+    wake.notify_one();
+}
+
+int TileCache::tiles() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)index.size();
+}
+
+int TileCache::queued() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)wanted.size();
+}
+
+int TileCache::claim() {
+    int slot = -1;
+    if ((int)index.size() < slots) {
+        for (int s = 0; s < slots && slot < 0; s++) {
+            if (!entry(s)->used) slot = s;
+        }
+    } else {
+        slot = 0;
+        for (int s = 1; s < slots; s++) {
+            if (entry(s)->last_used < entry(slot)->last_used) slot = s;
+        }
+        index.erase(entry(slot)->key);
+    }
+    entry(slot)->used = 0;
+    return slot;
+}
+
+void TileCache::worker_loop() {
+    // leaves a core for the render loop
+    TileScheduler scheduler(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+    std::vector<float> tile((size_t)TILE_SIZE * TILE_SIZE);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return quit || !wanted.empty(); });
+        if (quit) return;
+        auto [key, view] = wanted.back();
+        wanted.pop_back();
+        if (index.count(key)) continue;
+        lock.unlock();
+
+        double spacing = std::ldexp(4.0 / TILE_SIZE, -key.level);
+        view.camera_x = (key.tx * TILE_SIZE + TILE_SIZE / 2) * spacing;
+        view.camera_y = (key.ty * TILE_SIZE + TILE_SIZE / 2) * spacing;
+        std::fill(std::begin(view.camera_x_tail), std::end(view.camera_x_tail), 0.0);
+        std::fill(std::begin(view.camera_y_tail), std::end(view.camera_y_tail), 0.0);
+        view.zoom = 2.0 / (TILE_SIZE * spacing);
+        view.aspect = 1.0;
+        view.numeric = (Numeric)key.numeric;
+        view.jitter_x = view.jitter_y = 0.0;
+        view.image_width = view.image_height = 0;
+        view.origin_x = view.origin_y = 0;
+        cpu_render_escape(view, tile.data(), TILE_SIZE, TILE_SIZE, scheduler);
+
+        lock.lock();
+        if (quit) return;
+        if (index.count(key)) continue;
+        // the data goes in before the entry says it's there
+        int slot = claim();
+        std::memcpy(data(slot), tile.data(), TILE_BYTES);
+        Entry* e = entry(slot);
+        e->key = key;
+        e->last_used = ++((Header*)base)->clock;
+        e->used = 1;
+        index[key] = slot;
+    }
+}
@@ -0,0 +1,73 @@
+#include "time_slicer.h"
+
+#include <algorithm>
+
+static constexpr int TILE_SIZE = 128;
+
+TimeSlicer::TimeSlicer() { glGenQueries(QUERIES, queries); }
+TimeSlicer::~TimeSlicer() { glDeleteQueries(QUERIES, queries); }
+
+void TimeSlicer::start(const std::vector<Tile>& regions, int center_x, int center_y) {
+    queue.clear();
+    next = 0;
+    for (const Tile& r : regions) {
+        for (int y = r.y0; y < r.y0 + r.h; y += TILE_SIZE) {
+            for (int x = r.x0; x < r.x0 + r.w; x += TILE_SIZE) {
+                queue.push_back({x, y, std::min(TILE_SIZE, r.x0 + r.w - x), std::min(TILE_SIZE, r.y0 + r.h - y)});
+            }
+        }
+    }
+    // the center is what you're looking at
+    auto distance = [&](const Tile& t) {
+        long long dx = 2 * t.x0 + t.w - 2 * center_x, dy = 2 * t.y0 + t.h - 2 * center_y;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(queue.begin(), queue.end(), [&](const Tile& a, const Tile& b) { return distance(a) < distance(b); });
+}
+
+// reads back the batches the gpu is done with
+void TimeSlicer::collect() {
+    for (int i = 0; i < QUERIES; i++) {
+        if (query_pixels[i] == 0) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+        double measured = (double)ns / query_pixels[i];
+        // smoothed, the cost per pixel swings a lot between the set and the outside
+        ns_per_pixel = ns_per_pixel > 0.0 ? 0.5 * (ns_per_pixel + measured) : measured;
+        gpu_ms = ns * 1e-6;
+        query_pixels[i] = 0;
+    }
+}
+
+void TimeSlicer::run(double budget_ms, const DrawFn& draw) {
+    collect();
+    if (!pending()) return;
+    // with every query still in flight the batch just goes unmeasured
+    int slot = query_pixels[query_next] == 0 ? query_next : -1;
+    if (slot >= 0) glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+
+    glEnable(GL_SCISSOR_TEST);
+    double spent_ms = 0.0;
+    long long pixels = 0;
+    while (next < queue.size()) {
+        const Tile& t = queue[next];
+        double cost_ms = ns_per_pixel * t.w * t.h * 1e-6;
+        // nothing measured yet: one tile, and wait for its timing
+        if (pixels > 0 && (ns_per_pixel == 0.0 || spent_ms + cost_ms > budget_ms)) break;
+        glScissor(t.x0, t.y0, t.w, t.h);
+        draw();
+        spent_ms += cost_ms;
+        pixels += (long long)t.w * t.h;
+        next++;
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    if (slot >= 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        query_pixels[slot] = std::max(1LL, pixels);
+        query_next = (query_next + 1) % QUERIES;
+    }
+}